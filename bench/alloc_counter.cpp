@@ -0,0 +1,57 @@
+/*
+ * Tiny allocation counter that the benchmark harness preloads into the engines.
+ * We replace the global operator new family, count every call and write the
+ * total to the file named by CLOXPP_ALLOC_LOG when the process exits.
+ */
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<unsigned long long> allocations{0};
+
+// Shared helper for every operator new overload
+static void *counted_alloc(std::size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (size == 0) {
+        size = 1;
+    }
+    void *ptr = std::malloc(size);
+    if (ptr == nullptr) {
+        throw std::bad_alloc{};
+    }
+    return ptr;
+}
+
+void *operator new(std::size_t size) { return counted_alloc(size); }
+void *operator new[](std::size_t size) { return counted_alloc(size); }
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+    try {
+        return counted_alloc(size);
+    } catch (...) {
+        return nullptr;
+    }
+}
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+    try {
+        return counted_alloc(size);
+    } catch (...) {
+        return nullptr;
+    }
+}
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+void operator delete[](void *ptr) noexcept { std::free(ptr); }
+void operator delete(void *ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void *ptr, std::size_t) noexcept { std::free(ptr); }
+
+// We report the count when the engine exits
+__attribute__((destructor)) static void report_allocations() {
+    const char *path = std::getenv("CLOXPP_ALLOC_LOG");
+    if (path == nullptr) {
+        return;
+    }
+    if (std::FILE *file = std::fopen(path, "w")) {
+        std::fprintf(file, "%llu\n", allocations.load());
+        std::fclose(file);
+    }
+}
@@ -0,0 +1,195 @@
+/*
+ * Benchmark harness for cloxpp. We run every workload in bench/workloads N times
+ * under each engine we were given and print min/median/p95 wall time, peak RSS
+ * and allocation counts as JSON so runs can be diffed and tracked over time.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cxxopts.hpp>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+#ifndef CLOXPP_BENCH_DIR
+#define CLOXPP_BENCH_DIR "bench/workloads"
+#endif
+#ifndef CLOXPPTW_PATH
+#define CLOXPPTW_PATH ""
+#endif
+#ifndef CLOXPPVM_PATH
+#define CLOXPPVM_PATH ""
+#endif
+#ifndef CLOXPP_ALLOC_LIB
+#define CLOXPP_ALLOC_LIB ""
+#endif
+
+namespace fs = std::filesystem;
+
+// Measurements for a single run of a script
+struct Sample {
+    double wall_ms;
+    long peak_rss_kb;
+    long long allocations;
+    int status;
+};
+
+// An engine we benchmark, the name is only used in the report
+struct Engine {
+    std::string name;
+    std::string path;
+};
+
+// Function to run a single script once and measure it
+static Sample run_once(const Engine &engine, const fs::path &script, const std::string &alloc_lib) {
+    // The allocation counter writes its total to this file on exit
+    fs::path alloc_log = fs::temp_directory_path() / ("cloxpp_alloc_" + std::to_string(getpid()));
+    fs::remove(alloc_log);
+
+    auto start = std::chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (pid == 0) {
+        // We silence the script so printing does not dominate the timings
+        int null_fd = open("/dev/null", O_WRONLY);
+        dup2(null_fd, STDOUT_FILENO);
+        dup2(null_fd, STDERR_FILENO);
+        if (!alloc_lib.empty()) {
+            setenv("LD_PRELOAD", alloc_lib.c_str(), 1);
+            setenv("DYLD_INSERT_LIBRARIES", alloc_lib.c_str(), 1);
+            setenv("CLOXPP_ALLOC_LOG", alloc_log.c_str(), 1);
+        }
+        std::string script_path = script.string();
+        execl(engine.path.c_str(), engine.path.c_str(), "-f", script_path.c_str(), nullptr);
+        _exit(127);
+    }
+
+    // wait4 hands back the resource usage of the child as well
+    int status = 0;
+    struct rusage usage {};
+    wait4(pid, &status, 0, &usage);
+    auto end = std::chrono::steady_clock::now();
+
+    Sample sample{};
+    sample.wall_ms = std::chrono::duration<double, std::milli>(end - start).count();
+#ifdef __APPLE__
+    // macOS reports bytes instead of kilobytes
+    sample.peak_rss_kb = usage.ru_maxrss / 1024;
+#else
+    sample.peak_rss_kb = usage.ru_maxrss;
+#endif
+    sample.status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    sample.allocations = -1;
+    std::ifstream log(alloc_log);
+    if (log >> sample.allocations) {
+        fs::remove(alloc_log);
+    }
+    return sample;
+}
+
+// Nearest rank percentile over sorted timings
+static double percentile(const std::vector<double> &sorted, double p) {
+    std::size_t rank = static_cast<std::size_t>(p * static_cast<double>(sorted.size() - 1) + 0.5);
+    return sorted[std::min(rank, sorted.size() - 1)];
+}
+
+static int run_benchmarks(const cxxopts::ParseResult &result);
+
+int main(int argc, const char *argv[]) {
+    cxxopts::Options options("lox_bench", "Benchmark harness for the cloxpp engines");
+    options.add_options()("h,help", "This message")(
+        "tw", "Path to cloxpptw", cxxopts::value<std::string>()->default_value(CLOXPPTW_PATH))(
+        "vm", "Path to cloxppvm", cxxopts::value<std::string>()->default_value(CLOXPPVM_PATH))(
+        "d,dir", "Directory of .lox workloads",
+        cxxopts::value<std::string>()->default_value(CLOXPP_BENCH_DIR))(
+        "n,runs", "Runs per workload", cxxopts::value<int>()->default_value("5"))(
+        "alloc-lib", "Allocation counter to preload, empty to skip",
+        cxxopts::value<std::string>()->default_value(CLOXPP_ALLOC_LIB))(
+        "only", "Only run the workload with this name", cxxopts::value<std::string>());
+
+    try {
+        auto result{options.parse(argc, argv)};
+        if (result.count("help")) {
+            std::cout << options.help() << std::endl;
+            return 0;
+        }
+        return run_benchmarks(result);
+    } catch (const std::exception &e) {
+        std::cerr << "Error parsing arguments: " << e.what() << std::endl;
+        return 64;
+    }
+}
+
+// Main logic, runs every workload under every engine and prints the JSON report
+static int run_benchmarks(const cxxopts::ParseResult &result) {
+    // We collect the engines that were actually provided
+    std::vector<Engine> engines;
+    if (!result["tw"].as<std::string>().empty()) {
+        engines.push_back({"cloxpptw", result["tw"].as<std::string>()});
+    }
+    if (!result["vm"].as<std::string>().empty()) {
+        engines.push_back({"cloxppvm", result["vm"].as<std::string>()});
+    }
+    if (engines.empty()) {
+        std::cerr << "No engines to benchmark, pass --tw and/or --vm." << std::endl;
+        return 64;
+    }
+
+    // We gather the workloads in a stable order
+    std::vector<fs::path> scripts;
+    for (const fs::directory_entry &entry : fs::directory_iterator(result["dir"].as<std::string>())) {
+        if (entry.path().extension() != ".lox") {
+            continue;
+        }
+        if (result.count("only") && entry.path().stem() != result["only"].as<std::string>()) {
+            continue;
+        }
+        scripts.push_back(entry.path());
+    }
+    std::sort(scripts.begin(), scripts.end());
+
+    int runs = std::max(1, result["runs"].as<int>());
+    std::string alloc_lib = result["alloc-lib"].as<std::string>();
+
+    std::cout << "{\n  \"runs\": " << runs << ",\n  \"results\": [";
+    bool first = true;
+    bool any_failed = false;
+    for (const fs::path &script : scripts) {
+        for (const Engine &engine : engines) {
+            std::vector<double> timings;
+            long peak_rss_kb = 0;
+            long long allocations = -1;
+            int status = 0;
+            for (int i = 0; i < runs; ++i) {
+                Sample sample = run_once(engine, script, alloc_lib);
+                timings.push_back(sample.wall_ms);
+                peak_rss_kb = std::max(peak_rss_kb, sample.peak_rss_kb);
+                allocations = sample.allocations;
+                status = std::max(status, sample.status);
+            }
+            std::sort(timings.begin(), timings.end());
+
+            std::cout << (first ? "\n" : ",\n") << "    {\"workload\": \"" << script.stem().string()
+                      << "\", \"engine\": \"" << engine.name << "\", \"status\": " << status;
+            // Timings of a run that failed are not comparable with anything, so a
+            // failed entry only says that it failed
+            if (status != 0) {
+                std::cout << ", \"failed\": true}";
+                any_failed = true;
+            } else {
+                std::cout << ", \"min_ms\": " << timings.front()
+                          << ", \"median_ms\": " << percentile(timings, 0.5)
+                          << ", \"p95_ms\": " << percentile(timings, 0.95)
+                          << ", \"peak_rss_kb\": " << peak_rss_kb
+                          << ", \"allocations\": " << allocations << "}";
+            }
+            first = false;
+        }
+    }
+    std::cout << "\n  ]\n}" << std::endl;
+    return any_failed ? 1 : 0;
+}
@@ -0,0 +1,195 @@
+/*
+ * Microbenchmarks for the tree walker. We link cloxpp_lib directly and time
+ * the front end and runtime primitives in isolation, every input is fixed so
+ * two runs of the same build measure the same work.
+ */
+#include "core/interpreter.hpp"
+#include "core/parser.hpp"
+#include "core/program.hpp"
+#include "core/scanner.hpp"
+#include "runtime/environment.hpp"
+#include "runtime/resolver.hpp"
+
+#include <algorithm>
+#include <benchmark/benchmark.h>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+#ifndef CLOXPP_BENCH_DIR
+#define CLOXPP_BENCH_DIR "bench/workloads"
+#endif
+
+using namespace CppLox;
+namespace fs = std::filesystem;
+
+// We use every workload script as our front end corpus, sorted so the input
+// is the same from run to run
+static const std::string &corpus() {
+    static const std::string source = [] {
+        std::vector<fs::path> scripts;
+        for (const fs::directory_entry &entry : fs::directory_iterator(CLOXPP_BENCH_DIR)) {
+            if (entry.path().extension() == ".lox") {
+                scripts.push_back(entry.path());
+            }
+        }
+        std::sort(scripts.begin(), scripts.end());
+
+        std::stringstream buffer;
+        for (const fs::path &script : scripts) {
+            buffer << std::ifstream(script).rdbuf() << "\n";
+        }
+        return buffer.str();
+    }();
+    return source;
+}
+
+// Error state shared by the front end benchmarks, the corpus has no errors
+static LoxError errors;
+
+// Helper to parse a source string without timing it
+static std::vector<std::shared_ptr<Stmt>> parse(const std::string &source) {
+    Scanner scanner(source, errors);
+    Parser parser(scanner.scan_tokens(), errors);
+    return parser.parse();
+}
+
+static void BM_ScanTokens(benchmark::State &state) {
+    const std::string &source = corpus();
+    for (auto _ : state) {
+        Scanner scanner(source, errors);
+        benchmark::DoNotOptimize(scanner.scan_tokens());
+    }
+    state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations() * source.size()));
+}
+BENCHMARK(BM_ScanTokens);
+
+static void BM_Parse(benchmark::State &state) {
+    Scanner scanner(corpus(), errors);
+    std::vector<Token> tokens = scanner.scan_tokens();
+    for (auto _ : state) {
+        Parser parser(tokens, errors);
+        benchmark::DoNotOptimize(parser.parse());
+    }
+    state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * tokens.size()));
+}
+BENCHMARK(BM_Parse);
+
+static void BM_Resolve(benchmark::State &state) {
+    std::vector<std::shared_ptr<Stmt>> stmts = parse(corpus());
+    for (auto _ : state) {
+        // A fresh map each time so we measure inserting every local
+        std::map<std::shared_ptr<Expr>, int> locals;
+        std::map<std::shared_ptr<Class>, std::vector<std::string>> class_fields;
+        std::size_t property_sites = 0;
+        Resolver resolver(locals, class_fields, property_sites, errors);
+        resolver.resolve(stmts);
+        benchmark::DoNotOptimize(locals.size());
+    }
+}
+BENCHMARK(BM_Resolve);
+
+static void BM_EnvironmentDefine(benchmark::State &state) {
+    Environment environment;
+    for (auto _ : state) {
+        environment.define("value", 1.0);
+    }
+}
+BENCHMARK(BM_EnvironmentDefine);
+
+// We look up a variable the given number of scopes up the chain
+static void BM_EnvironmentGetAt(benchmark::State &state) {
+    int distance = static_cast<int>(state.range(0));
+    auto outermost = make_ref<Environment>();
+    outermost->define("value", 1.0);
+    Ref<Environment> innermost = outermost;
+    for (int i = 0; i < distance; ++i) {
+        innermost = make_ref<Environment>(innermost);
+        innermost->define("local", 0.0);
+    }
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(innermost->get_at(distance, "value"));
+    }
+}
+BENCHMARK(BM_EnvironmentGetAt)->Arg(0)->Arg(1)->Arg(4)->Arg(16);
+
+// Fixture with a small class hierarchy built by the interpreter itself
+class Classes : public benchmark::Fixture {
+  public:
+    void SetUp(const benchmark::State &) override {
+        interpreter = std::make_unique<Interpreter>();
+        Program program = compile("class Base {\n"
+                                  "  base() { return 1; }\n"
+                                  "  shared() { return 2; }\n"
+                                  "}\n"
+                                  "class Middle < Base {\n"
+                                  "  middle() { return 3; }\n"
+                                  "}\n"
+                                  "class Leaf < Middle {\n"
+                                  "  leaf() { return 4; }\n"
+                                  "  shared() { return 5; }\n"
+                                  "}\n"
+                                  "var obj = Leaf();\n"
+                                  "obj.x = 1;\n"
+                                  "obj.y = 2;\n"
+                                  "obj.z = 3;\n");
+        interpreter->execute(program);
+
+        klass = std::any_cast<Ref<LoxClass>>(interpreter->globals->get(ident("Leaf")));
+        instance =
+            std::any_cast<Ref<LoxInstance>>(interpreter->globals->get(ident("obj")));
+    }
+
+    void TearDown(const benchmark::State &) override {
+        instance = nullptr;
+        klass = nullptr;
+        interpreter.reset();
+    }
+
+    static Token ident(const std::string &name) {
+        return Token(TokenType::IDENTIFIER, name, {}, 1);
+    }
+
+    std::unique_ptr<Interpreter> interpreter;
+    Ref<LoxClass> klass;
+    Ref<LoxInstance> instance;
+};
+
+BENCHMARK_F(Classes, BM_FindMethodOwn)(benchmark::State &state) {
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(klass->find_method("leaf"));
+    }
+}
+
+BENCHMARK_F(Classes, BM_FindMethodInherited)(benchmark::State &state) {
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(klass->find_method("base"));
+    }
+}
+
+BENCHMARK_F(Classes, BM_InstanceGetField)(benchmark::State &state) {
+    Token name = ident("y");
+    // The interpreter resolves the slot once per access site, like we do here
+    int slot = klass->slot_of(name.lexeme);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(instance->get(name, slot));
+    }
+}
+
+BENCHMARK_F(Classes, BM_InstanceGetMethod)(benchmark::State &state) {
+    Token name = ident("middle");
+    int slot = klass->slot_of(name.lexeme);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(instance->get(name, slot));
+    }
+}
+
+BENCHMARK_F(Classes, BM_InstanceSet)(benchmark::State &state) {
+    Token name = ident("y");
+    int slot = klass->slot_of(name.lexeme);
+    for (auto _ : state) {
+        instance->set(name, 2.0, slot);
+    }
+}
+
+BENCHMARK_MAIN();
@@ -0,0 +1,313 @@
+/*
+ * Microbenchmarks for the bytecode VM. We link loxlib directly and time chunk
+ * construction and the dispatch loop on hand assembled bytecode, so every run
+ * executes exactly the same instructions. Programs are the body of a script
+ * function, so slot 0 of the stack holds the script itself.
+ */
+#include "chunk/chunk.hpp"
+#include "memory/heap.hpp"
+#include "table/table.hpp"
+#include "vm/vm.hpp"
+
+#include <benchmark/benchmark.h>
+#include <string>
+
+// Helper to emit a constant load
+static void emit_constant(Chunk &chunk, Value value) {
+    int index = chunk.add_constant(value);
+    chunk.write_chunk(OpCode::OP_CONSTANT, 1);
+    chunk.write_chunk(static_cast<std::uint8_t>(index), 1);
+}
+
+// Builds a straight line arithmetic program with the given number of rounds,
+// the stack stays at depth one between rounds
+static void assemble(Chunk &chunk, std::int64_t rounds) {
+    emit_constant(chunk, Value::number(1.0));
+    for (std::int64_t i = 0; i < rounds; ++i) {
+        emit_constant(chunk, Value::number(2.0));
+        chunk.write_chunk(OpCode::OP_ADD, 1);
+        emit_constant(chunk, Value::number(3.0));
+        chunk.write_chunk(OpCode::OP_MULTIPLY, 1);
+        chunk.write_chunk(OpCode::OP_NEGATE, 1);
+        emit_constant(chunk, Value::number(4.0));
+        chunk.write_chunk(OpCode::OP_DIVIDE, 1);
+        emit_constant(chunk, Value::number(5.0));
+        chunk.write_chunk(OpCode::OP_SUBTRACT, 1);
+    }
+    chunk.write_chunk(OpCode::OP_RETURN, 1);
+}
+
+static void BM_WriteChunk(benchmark::State &state) {
+    for (auto _ : state) {
+        Chunk chunk("bench");
+        for (std::int64_t i = 0; i < state.range(0); ++i) {
+            chunk.write_chunk(OpCode::OP_NEGATE, 1);
+        }
+        benchmark::DoNotOptimize(chunk.code_.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_WriteChunk)->Arg(256)->Arg(4096);
+
+// Every constant is distinct, so each one grows the pool
+static void BM_AddConstant(benchmark::State &state) {
+    for (auto _ : state) {
+        Chunk chunk("bench");
+        for (std::int64_t i = 0; i < state.range(0); ++i) {
+            benchmark::DoNotOptimize(chunk.add_constant(Value::number(static_cast<double>(i))));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_AddConstant)->Arg(16)->Arg(256);
+
+// Dispatch loop throughput, items are executed instructions
+static void BM_VMRun(benchmark::State &state) {
+    VM vm("");
+    ObjFunction *script = vm.heap_.allocate<ObjFunction>();
+    assemble(script->chunk_, state.range(0));
+    // One load up front, nine instructions a round and the return
+    std::int64_t instructions = 1 + state.range(0) * 9 + 1;
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(vm.run_function(script));
+    }
+    state.SetItemsProcessed(state.iterations() * instructions);
+}
+BENCHMARK(BM_VMRun)->Arg(16)->Arg(1024);
+
+// Builds a program that cycles through most opcodes with little work in each,
+// so the time is dominated by dispatch rather than arithmetic. The jumps skip
+// nothing and every round leaves the stack as it found it.
+static std::int64_t assemble_dispatch(Chunk &chunk, std::int64_t rounds) {
+    for (std::int64_t i = 0; i < rounds; ++i) {
+        chunk.write_chunk(OpCode::OP_TRUE, 1);
+        chunk.write_chunk(OpCode::OP_NOT, 1);
+        chunk.write_chunk(OpCode::OP_JUMP_IF_FALSE, 1);
+        chunk.write_chunk(0, 1);
+        chunk.write_chunk(0, 1);
+        chunk.write_chunk(OpCode::OP_POP, 1);
+        chunk.write_chunk(OpCode::OP_NIL, 1);
+        chunk.write_chunk(OpCode::OP_FALSE, 1);
+        chunk.write_chunk(OpCode::OP_EQUAL, 1);
+        chunk.write_chunk(OpCode::OP_POP, 1);
+        emit_constant(chunk, Value::number(1.0));
+        emit_constant(chunk, Value::number(2.0));
+        chunk.write_chunk(OpCode::OP_LESS, 1);
+        chunk.write_chunk(OpCode::OP_JUMP, 1);
+        chunk.write_chunk(0, 1);
+        chunk.write_chunk(0, 1);
+        chunk.write_chunk(OpCode::OP_POP, 1);
+    }
+    chunk.write_chunk(OpCode::OP_NIL, 1);
+    chunk.write_chunk(OpCode::OP_RETURN, 1);
+    return rounds * 13 + 2;
+}
+
+// Dispatch heavy loop, labelled with the dispatch mode and value representation
+// so builds with different CLOXPPVM_DISPATCH and CLOXPPVM_VALUE line up
+static void BM_VMDispatch(benchmark::State &state) {
+    VM vm("");
+    ObjFunction *script = vm.heap_.allocate<ObjFunction>();
+    std::int64_t instructions = assemble_dispatch(script->chunk_, state.range(0));
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(vm.run_function(script));
+    }
+    state.SetItemsProcessed(state.iterations() * instructions);
+    state.SetLabel(fmt::format("{} {}", DISPATCH_NAME, Value::repr_name));
+}
+BENCHMARK(BM_VMDispatch)->Arg(16)->Arg(1024);
+
+// Helper to emit an instruction with a 16 bit operand
+static void emit_short(Chunk &chunk, OpCode op, std::size_t operand) {
+    chunk.write_chunk(op, 1);
+    chunk.write_chunk(static_cast<std::uint8_t>((operand >> 8) & 0xff), 1);
+    chunk.write_chunk(static_cast<std::uint8_t>(operand & 0xff), 1);
+}
+
+// Global variable traffic, the equivalent of a = a + b repeated, items are
+// executed instructions
+static void BM_VMGlobals(benchmark::State &state) {
+    VM vm("");
+    std::size_t a = vm.globals_.slot_of(vm.heap_.intern("a"));
+    std::size_t b = vm.globals_.slot_of(vm.heap_.intern("b"));
+    // Allocated last, nothing roots the script until it runs
+    ObjFunction *script = vm.heap_.allocate<ObjFunction>();
+    Chunk &chunk = script->chunk_;
+    emit_constant(chunk, Value::number(0.0));
+    emit_short(chunk, OpCode::OP_DEFINE_GLOBAL, a);
+    emit_constant(chunk, Value::number(1.0));
+    emit_short(chunk, OpCode::OP_DEFINE_GLOBAL, b);
+    for (std::int64_t i = 0; i < state.range(0); ++i) {
+        emit_short(chunk, OpCode::OP_GET_GLOBAL, a);
+        emit_short(chunk, OpCode::OP_GET_GLOBAL, b);
+        chunk.write_chunk(OpCode::OP_ADD, 1);
+        emit_short(chunk, OpCode::OP_SET_GLOBAL, a);
+        chunk.write_chunk(OpCode::OP_POP, 1);
+    }
+    chunk.write_chunk(OpCode::OP_NIL, 1);
+    chunk.write_chunk(OpCode::OP_RETURN, 1);
+    std::int64_t instructions = 4 + state.range(0) * 5 + 2;
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(vm.run_function(script));
+    }
+    state.SetItemsProcessed(state.iterations() * instructions);
+}
+BENCHMARK(BM_VMGlobals)->Arg(1024);
+
+// The same traffic on locals, which live directly in stack slots
+static void BM_VMLocals(benchmark::State &state) {
+    VM vm("");
+    ObjFunction *script = vm.heap_.allocate<ObjFunction>();
+    Chunk &chunk = script->chunk_;
+    emit_constant(chunk, Value::number(0.0));
+    emit_constant(chunk, Value::number(1.0));
+    for (std::int64_t i = 0; i < state.range(0); ++i) {
+        chunk.write_chunk(OpCode::OP_GET_LOCAL, 1);
+        chunk.write_chunk(1, 1);
+        chunk.write_chunk(OpCode::OP_GET_LOCAL, 1);
+        chunk.write_chunk(2, 1);
+        chunk.write_chunk(OpCode::OP_ADD, 1);
+        chunk.write_chunk(OpCode::OP_SET_LOCAL, 1);
+        chunk.write_chunk(1, 1);
+        chunk.write_chunk(OpCode::OP_POP, 1);
+    }
+    chunk.write_chunk(OpCode::OP_POPN, 1);
+    chunk.write_chunk(2, 1);
+    chunk.write_chunk(OpCode::OP_NIL, 1);
+    chunk.write_chunk(OpCode::OP_RETURN, 1);
+    std::int64_t instructions = 2 + state.range(0) * 5 + 3;
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(vm.run_function(script));
+    }
+    state.SetItemsProcessed(state.iterations() * instructions);
+}
+BENCHMARK(BM_VMLocals)->Arg(1024);
+
+// Call and return overhead, the equivalent of id(1) repeated with
+// fun id(x) { return x; }. Items are calls
+static void BM_VMCalls(benchmark::State &state) {
+    VM vm("");
+    ObjFunction *script = vm.heap_.allocate<ObjFunction>();
+    // The callee is only reachable through the script's constants, which the
+    // stack roots while the benchmark runs
+    ObjFunction *id = vm.heap_.allocate<ObjFunction>();
+    id->arity_ = 1;
+    id->chunk_.write_chunk(OpCode::OP_GET_LOCAL, 1);
+    id->chunk_.write_chunk(1, 1);
+    id->chunk_.write_chunk(OpCode::OP_RETURN, 1);
+    ObjClosure *id_closure = vm.heap_.allocate<ObjClosure>(id);
+
+    Chunk &chunk = script->chunk_;
+    auto callee = static_cast<std::uint8_t>(chunk.add_constant(Value::obj(id_closure)));
+    auto argument = static_cast<std::uint8_t>(chunk.add_constant(Value::number(1.0)));
+    for (std::int64_t i = 0; i < state.range(0); ++i) {
+        chunk.write_chunk(OpCode::OP_CONSTANT, 1);
+        chunk.write_chunk(callee, 1);
+        chunk.write_chunk(OpCode::OP_CONSTANT, 1);
+        chunk.write_chunk(argument, 1);
+        chunk.write_chunk(OpCode::OP_CALL, 1);
+        chunk.write_chunk(1, 1);
+        chunk.write_chunk(OpCode::OP_POP, 1);
+    }
+    chunk.write_chunk(OpCode::OP_NIL, 1);
+    chunk.write_chunk(OpCode::OP_RETURN, 1);
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(vm.run_function(script));
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.SetLabel(fmt::format("{} {}", DISPATCH_NAME, Value::repr_name));
+}
+BENCHMARK(BM_VMCalls)->Arg(1024);
+
+// Reads of a captured variable from inside a closure, the equivalent of x + x
+// repeated in fun read() { ... } with x a local of the script. Arg 0 captures x
+// by copy as when it is never reassigned, 1 boxes it in an upvalue. Compare
+// with BM_VMLocals for plain local reads. Items are executed instructions
+static void BM_VMUpvalues(benchmark::State &state) {
+    VM vm("");
+    ObjFunction *script = vm.heap_.allocate<ObjFunction>();
+    ObjFunction *read = vm.heap_.allocate<ObjFunction>();
+    bool boxed = state.range(0) != 0;
+    read->upvalue_count_ = 1;
+    OpCode get = boxed ? OpCode::OP_GET_UPVALUE : OpCode::OP_GET_UPVALUE_COPY;
+    constexpr std::int64_t rounds = 1024;
+    for (std::int64_t i = 0; i < rounds; ++i) {
+        read->chunk_.write_chunk(get, 1);
+        read->chunk_.write_chunk(0, 1);
+        read->chunk_.write_chunk(get, 1);
+        read->chunk_.write_chunk(0, 1);
+        read->chunk_.write_chunk(OpCode::OP_ADD, 1);
+        read->chunk_.write_chunk(OpCode::OP_POP, 1);
+    }
+    read->chunk_.write_chunk(OpCode::OP_NIL, 1);
+    read->chunk_.write_chunk(OpCode::OP_RETURN, 1);
+
+    // var x = 1; fun read() { ... } read();
+    Chunk &chunk = script->chunk_;
+    emit_constant(chunk, Value::number(1.0));
+    chunk.write_chunk(OpCode::OP_CLOSURE, 1);
+    chunk.write_chunk(static_cast<std::uint8_t>(chunk.add_constant(Value::obj(read))), 1);
+    CaptureKind capture = boxed ? CaptureKind::CAPTURE_BOX : CaptureKind::CAPTURE_COPY;
+    chunk.write_chunk(static_cast<std::uint8_t>(capture), 1);
+    chunk.write_chunk(0, 1);
+    chunk.write_chunk(1, 1);
+    chunk.write_chunk(OpCode::OP_GET_LOCAL, 1);
+    chunk.write_chunk(2, 1);
+    chunk.write_chunk(OpCode::OP_CALL, 1);
+    chunk.write_chunk(0, 1);
+    chunk.write_chunk(OpCode::OP_NIL, 1);
+    chunk.write_chunk(OpCode::OP_RETURN, 1);
+    std::int64_t instructions = rounds * 4 + 2;
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(vm.run_function(script));
+    }
+    state.SetItemsProcessed(state.iterations() * instructions);
+    state.SetLabel(boxed ? "boxed" : "copy");
+}
+BENCHMARK(BM_VMUpvalues)->Arg(0)->Arg(1);
+
+// Lookups of interned keys, the hit path of globals and fields
+static void BM_TableGet(benchmark::State &state) {
+    Heap heap;
+    Table table;
+    std::vector<ObjString *> keys;
+    for (std::int64_t i = 0; i < state.range(0); ++i) {
+        keys.push_back(heap.intern("key" + std::to_string(i)));
+        table.set(keys.back(), Value::number(static_cast<double>(i)));
+    }
+
+    Value value = Value::nil();
+    for (auto _ : state) {
+        for (ObjString *key : keys) {
+            benchmark::DoNotOptimize(table.get(key, &value));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_TableGet)->Arg(16)->Arg(4096);
+
+// Interning strings that already exist, what concatenation and literals pay
+static void BM_InternHit(benchmark::State &state) {
+    Heap heap;
+    std::vector<std::string> names;
+    for (std::int64_t i = 0; i < state.range(0); ++i) {
+        names.push_back("name" + std::to_string(i));
+        heap.intern(names.back());
+    }
+
+    for (auto _ : state) {
+        for (const std::string &name : names) {
+            benchmark::DoNotOptimize(heap.intern(name));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_InternHit)->Arg(16)->Arg(4096);
+
+BENCHMARK_MAIN();
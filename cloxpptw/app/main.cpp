@@ -13,19 +13,46 @@ int main(int argc, const char *argv[]) {
     // By default options are added as booleans so we need to add a type
     // in order to properly parse args
     options.add_options()("h,help", "help")("repl", "REPL Entry Point")(
-        "f,file", "Lox Script", cxxopts::value<std::string>());
+        "f,file", "Lox Script", cxxopts::value<std::string>())(
+        "max-depth", "Maximum call depth before a stack overflow error",
+        cxxopts::value<std::size_t>()->default_value("10000"))(
+        "memoize", "Cache results of pure functions")(
+        "profile", "Report per function timings and line hits")(
+        "profile-out", "Folded stack output for --profile",
+        cxxopts::value<std::string>()->default_value("cloxpp.folded"))(
+        "pool-stats", "Report the environment pool hit rate")(
+        "batch", "Run every script in a directory or listed in a file",
+        cxxopts::value<std::string>())(
+        "j,jobs", "Worker threads for --batch, 0 uses every core",
+        cxxopts::value<unsigned>()->default_value("0"));
 
     // We use a try block in case the user makes a crazy input for some reason
     try {
         // We can now parse our options
         auto result{options.parse(argc, argv)};
 
+        // We collect the runtime settings for the interpreter
+        CppLox::InterpreterConfig config;
+        config.max_call_depth = result["max-depth"].as<std::size_t>();
+        if (config.max_call_depth > CppLox::MAX_CALL_DEPTH) {
+            std::cerr << "Error: --max-depth can be at most " << CppLox::MAX_CALL_DEPTH
+                      << std::endl;
+            return EXIT_FAILURE;
+        }
+        config.memoize = result.count("memoize") > 0;
+        config.profile = result.count("profile") > 0;
+        config.profile_path = result["profile-out"].as<std::string>();
+        config.pool_stats = result.count("pool-stats") > 0;
+
         if (result.count("help")) {
             std::cout << options.help() << std::endl;
         } else if (result.count("file")) {
-            CppLox::Lox::run_file(result["file"].as<std::string>());
+            CppLox::Lox::run_file(result["file"].as<std::string>(), config);
         } else if (result.count("repl")) {
-            CppLox::Lox::run_prompt();
+            CppLox::Lox::run_prompt(config);
+        } else if (result.count("batch")) {
+            return CppLox::Lox::run_batch(result["batch"].as<std::string>(),
+                                          result["jobs"].as<unsigned>(), config);
         }
     } catch (const std::exception &e) {
         std::cerr << "Error parsing arguments: " << e.what() << std::endl;
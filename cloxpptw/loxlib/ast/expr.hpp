@@ -5,6 +5,7 @@
 #include "utils/tokens.hpp"
 
 #include <any>
+#include <cstddef>
 #include <memory>
 #include <utility> // for std::move
 #include <vector>
@@ -165,6 +166,8 @@ struct Set : Expr, std::enable_shared_from_this<Set> {
     Token name;
     // Pointer to value
     std::shared_ptr<Expr> value;
+    // Index of this access in the program's slot cache, set by the resolver
+    std::size_t site = 0;
 };
 
 struct Get : Expr, std::enable_shared_from_this<Get> {
@@ -188,6 +191,8 @@ struct Get : Expr, std::enable_shared_from_this<Get> {
     std::shared_ptr<Expr> object;
     // Token name
     Token name;
+    // Index of this access in the program's slot cache, set by the resolver
+    std::size_t site = 0;
 };
 
 struct Call : Expr, std::enable_shared_from_this<Call> {
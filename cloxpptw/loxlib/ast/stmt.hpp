@@ -43,6 +43,9 @@ struct Stmt {
     // accept() method for visiting nodes, we pass in a reference to
     // ExprVisitor&
     virtual std::any accept(StmtVisitor &visitor) = 0;
+
+    // Line the statement starts on, set by the parser
+    int line = 0;
 };
 
 // Return statement node
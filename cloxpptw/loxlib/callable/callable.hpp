@@ -2,8 +2,8 @@
 #define CALLABLE_HPP
 
 #include <any>
+#include <span>
 #include <string>
-#include <vector>
 
 namespace CppLox {
 
@@ -12,10 +12,12 @@ class Interpreter;
 // Interface for the LoxCallable Class
 // we define a handful of virtual methods that we need to override whenever
 // we inherit from this class
+// call only borrows its arguments, callees copy what they need to keep before
+// running any Lox code since the caller's buffer may move afterwards
 class LoxCallable {
   public:
     virtual int arity() = 0;
-    virtual std::any call(Interpreter &interpreter, std::vector<std::any> arguments) = 0;
+    virtual std::any call(Interpreter &interpreter, std::span<const std::any> arguments) = 0;
     virtual std::string to_string() = 0;
     virtual ~LoxCallable() = default;
 };
@@ -2,19 +2,42 @@
 
 #include "lox_classes.hpp"
 
+#include <atomic>
+
 using namespace CppLox;
 
+// Ids start at 1 so an empty slot cache entry never matches a class
+static std::atomic<std::uint64_t> next_class_id{1};
+
 // LoxClass constructor, we initialize with its name as a string and a method map
-LoxClass::LoxClass(std::string name, std::shared_ptr<LoxClass> superclass,
-                   std::map<std::string, std::shared_ptr<LoxFunction>> methods)
-    : name(std::move(name)), superclass(std::move(superclass)), methods(std::move(methods)) {}
+LoxClass::LoxClass(std::string name, Ref<LoxClass> superclass,
+                   std::map<std::string, Ref<LoxFunction>> methods,
+                   const std::vector<std::string> &init_fields)
+    : id(next_class_id.fetch_add(1, std::memory_order_relaxed)), name(std::move(name)),
+      superclass(std::move(superclass)), methods(std::move(methods)) {
+    // Our methods report themselves as Class.method to the profiler
+    for (auto &[method_name, method] : this->methods) {
+        method->owner = this;
+    }
+    // We inherit the superclass layout and append the fields only our init sets
+    if (this->superclass != nullptr) {
+        fields = this->superclass->fields;
+    }
+    for (const std::string &field : init_fields) {
+        if (slot_of(field) < 0) {
+            fields.push_back(field);
+        }
+    }
+}
 
 // Override for call method
-std::any LoxClass::call(Interpreter &interpreter, std::vector<std::any> arguments) {
+std::any LoxClass::call(Interpreter &interpreter, std::span<const std::any> arguments) {
+    // We time the construction if the profiler is on
+    Profiler::Scope profile(interpreter.profiler.get(), this, name);
     // We intialize our instance
-    std::shared_ptr<LoxInstance> instance = std::make_shared<LoxInstance>(shared_from_this());
+    Ref<LoxInstance> instance = LoxInstance::create(Ref<LoxClass>(this));
     // We search for an init method
-    std::shared_ptr<LoxFunction> initializer = find_method("init");
+    Ref<LoxFunction> initializer = find_method("init");
     // If we find one we bind and call it with its arguments
     if (initializer != nullptr) {
         initializer->bind(instance)->call(interpreter, arguments);
@@ -26,7 +49,7 @@ std::any LoxClass::call(Interpreter &interpreter, std::vector<std::any> argument
 // Override for arity
 int LoxClass::arity() {
     // We search for an init method
-    std::shared_ptr<LoxFunction> initializer = find_method("init");
+    Ref<LoxFunction> initializer = find_method("init");
     if (initializer == nullptr) {
         // we return 0 if we dont find it
         return 0;
@@ -39,7 +62,7 @@ int LoxClass::arity() {
 std::string LoxClass::to_string() { return name; }
 
 // Function to lookup methods in the map
-std::shared_ptr<LoxFunction> CppLox::LoxClass::find_method(std::string name) {
+Ref<LoxFunction> CppLox::LoxClass::find_method(std::string name) {
     // Test if function is contained inside the map
     if (methods.contains(name)) {
         return methods[name];
@@ -53,4 +76,14 @@ std::shared_ptr<LoxFunction> CppLox::LoxClass::find_method(std::string name) {
 
     // Otherwise return nullptr
     return nullptr;
-}
\ No newline at end of file
+}
+// Function to find a field slot, the interpreter caches the result for each
+// property access so this only runs when an access meets a new class
+int LoxClass::slot_of(const std::string &field) const {
+    for (std::size_t slot = 0; slot < fields.size(); ++slot) {
+        if (fields[slot] == field) {
+            return static_cast<int>(slot);
+        }
+    }
+    return -1;
+}
@@ -4,8 +4,10 @@
 #include "callable/callable.hpp"
 #include "callable/lox_functions.hpp"
 #include "utils/error.hpp"
+#include "utils/ref.hpp"
 
 #include <any>
+#include <cstdint>
 #include <iostream>
 #include <map>
 #include <memory>
@@ -17,28 +19,36 @@ class Interpreter;
 struct LoxInstance;
 class LoxFunction;
 
-class LoxClass : public LoxCallable, public std::enable_shared_from_this<LoxClass> {
+class LoxClass : public LoxCallable, public RefCounted {
   public:
-    // Constructor for LoxClass, we pass in its name
-    LoxClass(std::string name, std::shared_ptr<LoxClass> superclass,
-             std::map<std::string, std::shared_ptr<LoxFunction>> methods);
+    // Constructor for LoxClass, we pass in its name and the fields its init sets
+    LoxClass(std::string name, Ref<LoxClass> superclass,
+             std::map<std::string, Ref<LoxFunction>> methods,
+             const std::vector<std::string> &init_fields);
 
     // Override for call from LoxCallable interface
-    std::any call(Interpreter &interpreter, std::vector<std::any> arguments) override;
+    std::any call(Interpreter &interpreter, std::span<const std::any> arguments) override;
     // Override for arity from LoxCallable Interface
     int arity() override;
     // Override for to_string from LoxCallable interface
     std::string to_string() override;
 
     // Function to lookup methods in class object
-    std::shared_ptr<LoxFunction> find_method(std::string name);
+    Ref<LoxFunction> find_method(std::string name);
+    // Function to find the slot of a field in our layout, -1 if it has none
+    int slot_of(const std::string &field) const;
 
+    // Unique for every class any thread creates, property sites remember the
+    // class they last saw by this instead of holding on to it
+    std::uint64_t id;
     // Class name
     std::string name;
     // Pointer to superclass
-    std::shared_ptr<LoxClass> superclass;
+    Ref<LoxClass> superclass;
     // Map of methods
-    std::map<std::string, std::shared_ptr<LoxFunction>> methods;
+    std::map<std::string, Ref<LoxFunction>> methods;
+    // Field layout of our instances, the superclass fields come first
+    std::vector<std::string> fields;
 };
 
 } // namespace CppLox
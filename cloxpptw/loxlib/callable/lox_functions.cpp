@@ -2,6 +2,8 @@
 
 #include "lox_functions.hpp"
 
+#include <bit>
+
 using namespace CppLox;
 using std::any;
 using std::string;
@@ -10,9 +12,10 @@ using std::vector;
 // Constructor for lox function class, we pass in a declaration and environment
 // and move ownership
 LoxFunction::LoxFunction(std::shared_ptr<Function> declaration,
-                         std::shared_ptr<Environment> closure, bool is_initializer)
+                         Ref<Environment> closure, bool is_initializer,
+                         std::shared_ptr<const Resolution> resolution)
     : declaration(std::move(declaration)), closure(std::move(closure)),
-      is_initializer(is_initializer) {}
+      is_initializer(is_initializer), resolution(std::move(resolution)) {}
 
 // A helper method to return the string representation of a function
 string LoxFunction::to_string() { return "<fn " + declaration->name.lexeme + ">"; }
@@ -21,7 +24,38 @@ string LoxFunction::to_string() { return "<fn " + declaration->name.lexeme + ">"
 int LoxFunction::arity() { return declaration->params.size(); }
 
 // we override the LoxCallable call method
-any LoxFunction::call(Interpreter &interpreter, vector<any> arguments) {
+any LoxFunction::call(Interpreter &interpreter, std::span<const any> arguments) {
+    // We time the call if the profiler is on
+    Profiler::Scope profile(interpreter.profiler.get(), declaration.get(), declaration->name.lexeme,
+                            owner != nullptr ? std::string_view(owner->name) : std::string_view());
+
+    // Most functions are not memoized so we go straight to the body
+    if (memo == nullptr) {
+        return invoke(interpreter, arguments);
+    }
+
+    // We can only cache calls where every argument is a primitive value
+    MemoTable::Key key;
+    if (!make_memo_key(arguments, key)) {
+        return invoke(interpreter, arguments);
+    }
+
+    // We return the cached result if we have seen these arguments before
+    auto it = memo->entries.find(key);
+    if (it != memo->entries.end()) {
+        return it->second;
+    }
+
+    // Otherwise we run the function and remember the result while we have room
+    any result = invoke(interpreter, arguments);
+    if (memo->entries.size() < MemoTable::MAX_ENTRIES) {
+        memo->entries.emplace(std::move(key), result);
+    }
+    return result;
+}
+
+// Function to execute the function body in a fresh environment
+any LoxFunction::invoke(Interpreter &interpreter, std::span<const any> arguments) {
     /*
      * functions need to have their own enviroment, this is to ensure they have
      * their own scope
@@ -29,7 +63,10 @@ any LoxFunction::call(Interpreter &interpreter, vector<any> arguments) {
      * we do not move the environment since we are going to reuse the old
      * environment as soon as we leave the function body
      */
-    std::shared_ptr environment = std::make_shared<Environment>(closure);
+    Ref<Environment> environment = make_ref<Environment>(closure);
+    // The body is resolved against the program that declared us, which need
+    // not be the one currently running
+    Interpreter::ResolutionScope scope(interpreter.resolution, resolution.get());
 
     // we can then create an iterator that iterates over the paremeters and
     // defines them in the environment
@@ -55,13 +92,39 @@ any LoxFunction::call(Interpreter &interpreter, vector<any> arguments) {
     return nullptr;
 }
 
+// Function to turn on result caching for this function
+void LoxFunction::enable_memo() { memo = std::make_unique<MemoTable>(); }
+
+// Helper to convert the arguments into a key for the memo table
+bool LoxFunction::make_memo_key(std::span<const any> arguments, MemoTable::Key &key) {
+    key.reserve(arguments.size());
+    for (const any &argument : arguments) {
+        if (argument.type() == typeid(double)) {
+            key.emplace_back(std::bit_cast<std::uint64_t>(std::any_cast<double>(argument)));
+        } else if (argument.type() == typeid(bool)) {
+            key.emplace_back(std::any_cast<bool>(argument));
+        } else if (argument.type() == typeid(string)) {
+            key.emplace_back(std::any_cast<string>(argument));
+        } else if (argument.type() == typeid(nullptr)) {
+            key.emplace_back(std::monostate{});
+        } else {
+            // Functions, classes and instances have identity so we do not cache them
+            return false;
+        }
+    }
+    return true;
+}
+
 // Function to bind this to class instance
-std::shared_ptr<LoxFunction> LoxFunction::bind(std::shared_ptr<LoxInstance> instance) {
+Ref<LoxFunction> LoxFunction::bind(Ref<LoxInstance> instance) {
     // We create a new environment from the closure
-    std::shared_ptr<Environment> environment = std::make_shared<Environment>(closure);
+    Ref<Environment> environment = make_ref<Environment>(closure);
     // We then define this inside the LoxInstance
     environment->define("this", instance);
     // We then return a function with the declaration and environment
     // Thus every method, has a small 'world' with 'this' inside
-    return std::make_shared<LoxFunction>(declaration, environment, is_initializer);
+    Ref<LoxFunction> method =
+        make_ref<LoxFunction>(declaration, environment, is_initializer, resolution);
+    method->owner = owner;
+    return method;
 }
@@ -4,44 +4,74 @@
 #include "callable/callable.hpp"
 #include "callable/lox_classes.hpp"
 #include "core/interpreter.hpp"
+#include "utils/ref.hpp"
 
 #include <any>
+#include <cstdint>
+#include <map>
 #include <memory>
 #include <string>
+#include <variant>
 #include <vector>
 
 namespace CppLox {
 
 class Environment;
+class LoxClass;
 struct Function;
 struct LoxInstance;
+struct Resolution;
+
+// Bounded cache of results for pure functions, keyed by the primitive arguments
+struct MemoTable {
+    // Numbers are keyed by their bit pattern, NaN would break the map's ordering
+    // and -0 has to stay apart from 0
+    using Key = std::vector<std::variant<std::monostate, bool, std::uint64_t, std::string>>;
+    // Once the table is full we stop adding new entries
+    static constexpr std::size_t MAX_ENTRIES = 1 << 16;
+    std::map<Key, std::any> entries;
+};
 
 // We create a new Lox function class that is similar to our Native Functions
 // we override the same methods to make
-class LoxFunction : public LoxCallable {
+class LoxFunction : public LoxCallable, public RefCounted {
   public:
     /*
      * Lox Function constructor, we pass in a pointer to the underlying function
      * and environment
      */
-    LoxFunction(std::shared_ptr<Function> declaration, std::shared_ptr<Environment> closure,
-                bool is_initializer);
+    LoxFunction(std::shared_ptr<Function> declaration, Ref<Environment> closure,
+                bool is_initializer, std::shared_ptr<const Resolution> resolution);
     // Override to convert to string
     std::string to_string() override;
     // Override to represent arity()
     int arity() override;
     // Override to call method
-    std::any call(Interpreter &interpreter, std::vector<std::any> arguments) override;
+    std::any call(Interpreter &interpreter, std::span<const std::any> arguments) override;
 
-    std::shared_ptr<LoxFunction> bind(std::shared_ptr<LoxInstance> instance);
+    Ref<LoxFunction> bind(Ref<LoxInstance> instance);
+    // Turns on result caching, only valid for functions proven pure
+    void enable_memo();
 
     bool is_initializer;
     // Pointer to closure (enclosing environment)
-    std::shared_ptr<Environment> closure;
+    Ref<Environment> closure;
+    // Class that declared this method, nullptr for plain functions. The class
+    // outlives its methods, it holds them and bound ones hold an instance of it
+    const LoxClass *owner = nullptr;
 
   private:
     // Pointer to declaration
     std::shared_ptr<Function> declaration;
+    // Resolution of the program the declaration came from
+    std::shared_ptr<const Resolution> resolution;
+    // Result cache, nullptr unless the function is memoized
+    std::unique_ptr<MemoTable> memo;
+
+    // Function to run the body of the function
+    std::any invoke(Interpreter &interpreter, std::span<const std::any> arguments);
+    // Helper to build a cache key, returns false if an argument is not a primitive
+    static bool make_memo_key(std::span<const std::any> arguments, MemoTable::Key &key);
 };
 
 } // namespace CppLox
@@ -3,27 +3,59 @@
 #include "callable/lox_functions.hpp"
 #include "lox_instance.hpp"
 
+#include <new>
+
 using namespace CppLox;
 
-LoxInstance::LoxInstance(std::shared_ptr<LoxClass> klass) : klass(std::move(klass)) {}
+// The slots start right at the end of the object, so it has to end aligned for them
+static_assert(sizeof(LoxInstance) % alignof(std::any) == 0);
+
+Ref<LoxInstance> LoxInstance::create(Ref<LoxClass> klass) {
+    // The instance, its reference count and its slots share a single allocation
+    void *block = ::operator new(sizeof(LoxInstance) + klass->fields.size() * sizeof(std::any));
+    return Ref<LoxInstance>(new (block) LoxInstance(std::move(klass)));
+}
+
+LoxInstance::LoxInstance(Ref<LoxClass> klass) : klass(std::move(klass)) {
+    std::uninitialized_default_construct_n(slots(), this->klass->fields.size());
+}
+
+// The slots are not members, so we destroy them ourselves
+LoxInstance::~LoxInstance() { std::destroy_n(slots(), klass->fields.size()); }
 
 std::string LoxInstance::to_string() { return klass->name + " instance"; }
 
-std::any LoxInstance::get(Token name) {
-    // We check if the map contains the lexeme
-    if (fields.contains(name.lexeme)) {
-        // we then return it
-        return fields[name.lexeme];
+std::any LoxInstance::get(const Token &name, int slot) {
+    // We check the layout first and then the spilled fields
+    if (slot >= 0) {
+        if (slots()[slot].has_value()) {
+            return slots()[slot];
+        }
+    } else if (spilled != nullptr) {
+        auto field = spilled->find(name.lexeme);
+        if (field != spilled->end()) {
+            return field->second;
+        }
     }
 
     // We lookup the method in the class object
-    std::shared_ptr<LoxFunction> method = klass->find_method(name.lexeme);
+    Ref<LoxFunction> method = klass->find_method(name.lexeme);
     if (method != nullptr) {
-        return method->bind(shared_from_this());
+        return method->bind(Ref<LoxInstance>(this));
     }
 
     // Otherwise we throw an error
     throw RuntimeError(name, "Undefined property '" + name.lexeme + "'.");
 }
 
-void LoxInstance::set(Token name, std::any value) { fields[name.lexeme] = value; }
+void LoxInstance::set(const Token &name, std::any value, int slot) {
+    if (slot >= 0) {
+        slots()[slot] = std::move(value);
+        return;
+    }
+    // Fields the class layout does not know about go to the side table
+    if (spilled == nullptr) {
+        spilled = std::make_unique<std::map<std::string, std::any>>();
+    }
+    (*spilled)[name.lexeme] = std::move(value);
+}
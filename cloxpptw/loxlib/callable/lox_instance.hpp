@@ -2,6 +2,7 @@
 #define LOX_INSTANCE_HPP
 
 #include "callable/lox_classes.hpp"
+#include "utils/ref.hpp"
 
 #include <any>
 #include <iostream>
@@ -13,24 +14,43 @@ namespace CppLox {
 
 class LoxClass;
 
-struct LoxInstance : std::enable_shared_from_this<LoxInstance> {
-    /*
-     * Constructor for LoxInstance, we pass in a pointer to the class
-     */
-    LoxInstance(std::shared_ptr<LoxClass> klass);
+/*
+ * Instances keep the fields of their class layout in a fixed array of slots
+ * placed right behind the object, in the same allocation as the instance and its
+ * reference count. Fields the layout does not know about spill into a map that
+ * is only created when needed. An empty slot means the field has not been set yet.
+ */
+struct LoxInstance : RefCounted {
+    // Function to create an instance with room for every field in the class layout
+    static Ref<LoxInstance> create(Ref<LoxClass> klass);
+
+    ~LoxInstance();
+    LoxInstance(const LoxInstance &) = delete;
+    LoxInstance &operator=(const LoxInstance &) = delete;
+    // The block holding the instance and its slots came from create()
+    static void operator delete(void *block) { ::operator delete(block); }
 
     // String representation method for each instance
     std::string to_string();
 
-    // Function to return values from an instances properties
-    std::any get(Token name);
+    // Function to return values from an instances properties, slot is where the
+    // class layout keeps the field or -1 if it has none
+    std::any get(const Token &name, int slot);
 
     // Function to set values for an instances properties
-    void set(Token name, std::any value);
+    void set(const Token &name, std::any value, int slot);
 
     // Pointer to class
-    std::shared_ptr<LoxClass> klass;
-    std::map<std::string, std::any> fields;
+    Ref<LoxClass> klass;
+
+  private:
+    // Constructor for LoxInstance, the caller reserves room for the slots behind us
+    LoxInstance(Ref<LoxClass> klass);
+    // Fields in layout order, one per entry in klass->fields
+    std::any *slots() { return reinterpret_cast<std::any *>(this + 1); }
+
+    // Fields outside the layout, allocated on first use
+    std::unique_ptr<std::map<std::string, std::any>> spilled;
 };
 
 } // namespace CppLox
@@ -0,0 +1,216 @@
+#include "callable/lox_map.hpp"
+
+#include "lox_map.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <string_view>
+
+using namespace CppLox;
+using std::size_t;
+using std::span;
+
+// Smallest index we allocate, and the load factor (in quarters) we rebuild at
+static constexpr size_t MIN_SLOTS = 8;
+static constexpr size_t MAX_LOAD_QUARTERS = 3;
+
+// Function to hash a key, std::hash is the identity for numbers on some
+// standard libraries so we finish with a mixer to spread the bits
+size_t LoxMap::hash_key(const Key &key) {
+    std::uint64_t hash = 0;
+    switch (key.index()) {
+    case 0:
+        hash = std::get<bool>(key) ? 1 : 2;
+        break;
+    case 1: {
+        // -0 and 0 compare equal so they have to hash the same
+        double number = std::get<double>(key);
+        hash = std::hash<double>{}(number == 0.0 ? 0.0 : number);
+        break;
+    }
+    default:
+        hash = std::hash<std::string_view>{}(std::get<std::string>(key));
+        break;
+    }
+    // We fold in the key type so true and 1 end up in different places
+    hash ^= key.index() * 0x9e3779b97f4a7c15ULL;
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    return static_cast<size_t>(hash);
+}
+
+size_t LoxMap::probe(const Key &key, size_t hash) const {
+    size_t mask = slots.size() - 1;
+    auto tag = static_cast<std::uint32_t>(hash);
+    // Linear probing keeps the search inside a few cache lines
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        const Slot &slot = slots[i];
+        if (slot.index == EMPTY) {
+            return i;
+        }
+        if (slot.tag == tag) {
+            const Entry &entry = entries[slot.index];
+            if (entry.live && entry.key == key) {
+                return i;
+            }
+        }
+    }
+}
+
+std::any *LoxMap::find(const Key &key) {
+    if (count == 0) {
+        return nullptr;
+    }
+    const Slot &slot = slots[probe(key, hash_key(key))];
+    return slot.index == EMPTY ? nullptr : &entries[slot.index].value;
+}
+
+void LoxMap::set(Key key, std::any value) {
+    size_t hash = hash_key(key);
+    if (!slots.empty()) {
+        Slot &slot = slots[probe(key, hash)];
+        if (slot.index != EMPTY) {
+            entries[slot.index].value = std::move(value);
+            return;
+        }
+    }
+
+    // Deleted entries still occupy their slots, so they count towards the load
+    if ((entries.size() + 1) * 4 > slots.size() * MAX_LOAD_QUARTERS) {
+        // We only grow when the live entries need it, otherwise compacting is enough
+        size_t slot_count = std::max(MIN_SLOTS, slots.size());
+        while ((count + 1) * 4 > slot_count * MAX_LOAD_QUARTERS / 2) {
+            slot_count *= 2;
+        }
+        rebuild(slot_count);
+    }
+
+    Slot &slot = slots[probe(key, hash)];
+    slot.index = static_cast<std::uint32_t>(entries.size());
+    slot.tag = static_cast<std::uint32_t>(hash);
+    entries.push_back(Entry{std::move(key), std::move(value), hash, true});
+    ++count;
+}
+
+bool LoxMap::erase(const Key &key) {
+    if (count == 0) {
+        return false;
+    }
+    // The slot keeps pointing at the dead entry so later probes walk past it
+    Slot &slot = slots[probe(key, hash_key(key))];
+    if (slot.index == EMPTY) {
+        return false;
+    }
+    Entry &entry = entries[slot.index];
+    entry.live = false;
+    entry.value.reset();
+    --count;
+    return true;
+}
+
+const LoxMap::Entry &LoxMap::entry_at(size_t position) {
+    // Positions only line up once the deleted entries are gone
+    if (entries.size() != count) {
+        rebuild(slots.size());
+    }
+    return entries[position];
+}
+
+void LoxMap::rebuild(size_t slot_count) {
+    // We compact the live entries in place, keeping their order
+    size_t live = 0;
+    for (Entry &entry : entries) {
+        if (entry.live) {
+            if (&entries[live] != &entry) {
+                entries[live] = std::move(entry);
+            }
+            ++live;
+        }
+    }
+    entries.resize(live);
+
+    // We then reinsert everything using the cached hashes
+    slots.assign(slot_count, Slot{EMPTY, 0});
+    size_t mask = slot_count - 1;
+    for (size_t index = 0; index < entries.size(); ++index) {
+        size_t i = entries[index].hash & mask;
+        while (slots[i].index != EMPTY) {
+            i = (i + 1) & mask;
+        }
+        slots[i] = Slot{static_cast<std::uint32_t>(index),
+                        static_cast<std::uint32_t>(entries[index].hash)};
+    }
+}
+
+// Helpers to unpack native arguments, bad arguments become Lox runtime errors
+
+static LoxMap &as_map(const std::any &value) {
+    if (auto *map = std::any_cast<std::shared_ptr<LoxMap>>(&value)) {
+        return **map;
+    }
+    throw NativeError("Expected a map.");
+}
+
+static LoxMap::Key as_key(const std::any &value) {
+    if (auto *string = std::any_cast<std::string>(&value)) {
+        return *string;
+    }
+    if (auto *number = std::any_cast<double>(&value)) {
+        // NaN is not equal to itself so it could never be found again
+        if (std::isnan(*number)) {
+            throw NativeError("Map keys can't be NaN.");
+        }
+        return *number;
+    }
+    if (auto *boolean = std::any_cast<bool>(&value)) {
+        return *boolean;
+    }
+    throw NativeError("Map keys must be strings, numbers or booleans.");
+}
+
+static std::any from_key(const LoxMap::Key &key) {
+    return std::visit([](const auto &value) -> std::any { return value; }, key);
+}
+
+static const LoxMap::Entry &entry_at(LoxMap &map, const std::any &value) {
+    auto *number = std::any_cast<double>(&value);
+    if (number == nullptr || *number < 0 || std::floor(*number) != *number ||
+        *number >= static_cast<double>(map.size())) {
+        throw NativeError("Index out of range.");
+    }
+    return map.entry_at(static_cast<size_t>(*number));
+}
+
+void CppLox::define_map_natives(NativeRegistry &registry) {
+    registry.define("Map", 0,
+                    [](span<const std::any>) -> std::any { return std::make_shared<LoxMap>(); });
+    registry.define("map_size", 1, [](span<const std::any> args) -> std::any {
+        return static_cast<double>(as_map(args[0]).size());
+    });
+    // Missing keys read as nil, use map_has to tell them apart from stored nils
+    registry.define("map_get", 2, [](span<const std::any> args) -> std::any {
+        std::any *value = as_map(args[0]).find(as_key(args[1]));
+        return value == nullptr ? std::any{nullptr} : *value;
+    });
+    registry.define("map_set", 3, [](span<const std::any> args) -> std::any {
+        as_map(args[0]).set(as_key(args[1]), args[2]);
+        return nullptr;
+    });
+    registry.define("map_has", 2, [](span<const std::any> args) -> std::any {
+        return as_map(args[0]).find(as_key(args[1])) != nullptr;
+    });
+    registry.define("map_delete", 2, [](span<const std::any> args) -> std::any {
+        return as_map(args[0]).erase(as_key(args[1]));
+    });
+
+    // Iteration goes by position from 0 to map_size - 1 in insertion order
+    registry.define("map_key_at", 2, [](span<const std::any> args) -> std::any {
+        return from_key(entry_at(as_map(args[0]), args[1]).key);
+    });
+    registry.define("map_value_at", 2, [](span<const std::any> args) -> std::any {
+        return entry_at(as_map(args[0]), args[1]).value;
+    });
+}
@@ -0,0 +1,71 @@
+#ifndef LOX_MAP_HPP
+#define LOX_MAP_HPP
+
+#include "callable/native_functions.hpp"
+
+#include <any>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <variant>
+#include <vector>
+
+namespace CppLox {
+
+/*
+ * Hash map exposed to Lox through the Map natives. Entries live in a dense
+ * vector in insertion order and a separate open addressing index maps hashes
+ * to entries. The index slots are 8 bytes and carry part of the hash, so a
+ * probe only touches an entry when the hash already matches.
+ */
+class LoxMap {
+  public:
+    // Scripts can use strings, numbers and booleans as keys
+    using Key = std::variant<bool, double, std::string>;
+
+    struct Entry {
+        Key key;
+        std::any value;
+        std::size_t hash;
+        // Deleted entries stay behind until the next compaction
+        bool live;
+    };
+
+    // Function to find a value, nullptr if the key is missing
+    std::any *find(const Key &key);
+    void set(Key key, std::any value);
+    // Function to remove a key, returns false if it was not there
+    bool erase(const Key &key);
+    std::size_t size() const { return count; }
+    // Entries by position in insertion order, used for iteration
+    const Entry &entry_at(std::size_t position);
+
+    std::string to_string() const { return "<map " + std::to_string(count) + ">"; }
+
+  private:
+    struct Slot {
+        std::uint32_t index;
+        // Low bits of the entry's hash
+        std::uint32_t tag;
+    };
+    static constexpr std::uint32_t EMPTY = UINT32_MAX;
+
+    std::vector<Entry> entries;
+    // Power of two sized index, empty until the first insert
+    std::vector<Slot> slots;
+    // Number of live entries
+    std::size_t count = 0;
+
+    static std::size_t hash_key(const Key &key);
+    // Helper to find the slot holding key, or the empty slot where it would go
+    std::size_t probe(const Key &key, std::size_t hash) const;
+    // Helper to drop deleted entries and rebuild the index with the given size
+    void rebuild(std::size_t slot_count);
+};
+
+// Function to register the Map constructor and map_* natives
+void define_map_natives(NativeRegistry &registry);
+
+} // namespace CppLox
+
+#endif
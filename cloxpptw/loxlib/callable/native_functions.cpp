@@ -1,25 +1,59 @@
 #include "callable/native_functions.hpp"
 
+#include "callable/lox_map.hpp"
+#include "callable/number_array.hpp"
+#include "native_functions.hpp"
+#include "runtime/environment.hpp"
+
+#include <chrono>
+
 using namespace CppLox;
 
+NativeFunction::NativeFunction(std::string name, int arity, NativeFn fn)
+    : name(std::move(name)), num_params(arity), fn(std::move(fn)) {}
+
+int NativeFunction::arity() { return num_params; }
+
+// Interface call, we simply forward to the fast path
+std::any NativeFunction::call(Interpreter &interpreter, std::span<const std::any> arguments) {
+    return invoke(arguments);
+}
+
+// A way to represent the function as a string
+std::string NativeFunction::to_string() { return "<native fn>"; }
+
+void NativeRegistry::define(std::string name, int arity, NativeFn fn) {
+    natives.push_back(std::make_shared<NativeFunction>(std::move(name), arity, std::move(fn)));
+}
+
+void NativeRegistry::install(Environment &environment) const {
+    for (const std::shared_ptr<NativeFunction> &native : natives) {
+        environment.define(native->name, native);
+    }
+}
+
 /*
- * Native Clock function for Lox lang
- * Returns a double for the amount of time elapsed
+ * Native clock function for Lox lang
+ * Returns a double for the number of milliseconds since the epoch
  */
-int NativeClock::arity() { return 0; }
-
-// to make the call, we pass in a reference to the Interpreter and the list
-// of arguments we wish to run
-std::any NativeClock::call(Interpreter &interpreter, std::vector<std::any> arguments) {
+static std::any clock_native(std::span<const std::any> arguments) {
     // We first need to get time since epoch as a duration
     std::chrono::duration ticks = std::chrono::system_clock::now().time_since_epoch();
     // We can then cast the object to milliseconds
     long long ms = std::chrono::duration_cast<std::chrono::milliseconds>(ticks).count();
     // We then cast one last time to a double for compatability with our
     // interpreter
-    double result = static_cast<double>(ms);
-    return result;
+    return static_cast<double>(ms);
 }
 
-// A way to represent the method as a string
-std::string NativeClock::to_string() { return "<native fn>"; }
\ No newline at end of file
+// The builtins are created once and shared by every interpreter
+const NativeRegistry &NativeRegistry::builtins() {
+    static const NativeRegistry registry = [] {
+        NativeRegistry builtins;
+        builtins.define("clock", 0, clock_native);
+        define_number_array_natives(builtins);
+        define_map_natives(builtins);
+        return builtins;
+    }();
+    return registry;
+}
@@ -4,26 +4,65 @@
 #include "callable/callable.hpp"
 
 #include <any>
-#include <chrono>
-#include <iostream>
+#include <functional>
+#include <memory>
+#include <span>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
 namespace CppLox {
-// A clock method that is native to Lox itself
-class NativeClock : public LoxCallable {
+
+class Environment;
+
+// Signature every native function implements, arguments are borrowed for the call
+using NativeFn = std::function<std::any(std::span<const std::any> arguments)>;
+
+// Natives throw this for bad arguments, the interpreter turns it into a
+// RuntimeError at the call site
+class NativeError : public std::runtime_error {
   public:
-    // the number of arguments we pass in is always 0;
-    int arity() override;
+    using std::runtime_error::runtime_error;
+};
 
-    // to make the call, we pass in a reference to the Interpreter and the list
-    // of arguments we wish to run
-    std::any call(Interpreter &interpreter, std::vector<std::any> arguments) override;
+/*
+ * A function implemented in C++ and exposed to Lox. The interpreter calls
+ * natives through invoke() directly, the LoxCallable overrides are only there
+ * so they behave like any other callable.
+ */
+class NativeFunction : public LoxCallable {
+  public:
+    NativeFunction(std::string name, int arity, NativeFn fn);
 
-    // A way to represent the method as a string
+    int arity() override;
+    std::any call(Interpreter &interpreter, std::span<const std::any> arguments) override;
     std::string to_string() override;
+
+    // Fast path the interpreter uses for calls
+    std::any invoke(std::span<const std::any> arguments) const { return fn(arguments); }
+
+    const std::string name;
+    const int num_params;
+
+  private:
+    NativeFn fn;
+};
+
+// A set of natives that can be installed into any number of interpreters, the
+// functions are immutable so one registry can be shared between threads
+class NativeRegistry {
+    std::vector<std::shared_ptr<NativeFunction>> natives;
+
+  public:
+    // Function to declare a native with its name and arity
+    void define(std::string name, int arity, NativeFn fn);
+    // Function to define every native in an environment, usually the globals
+    void install(Environment &environment) const;
+
+    // The natives every interpreter starts with
+    static const NativeRegistry &builtins();
 };
 
 } // namespace CppLox
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,434 @@
+#include "callable/number_array.hpp"
+
+#include "number_array.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <new>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CLOXPP_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+using namespace CppLox;
+using std::size_t;
+using std::span;
+
+/*
+ * Scalar kernels, these are the fallback on every target and also finish the
+ * tails the vector loops leave behind
+ */
+static double sum_scalar(const double *data, size_t n) {
+    double total = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        total += data[i];
+    }
+    return total;
+}
+
+static double min_scalar(const double *data, size_t n) {
+    double result = data[0];
+    for (size_t i = 1; i < n; ++i) {
+        result = std::min(result, data[i]);
+    }
+    return result;
+}
+
+static double max_scalar(const double *data, size_t n) {
+    double result = data[0];
+    for (size_t i = 1; i < n; ++i) {
+        result = std::max(result, data[i]);
+    }
+    return result;
+}
+
+static double dot_scalar(const double *a, const double *b, size_t n) {
+    double total = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        total += a[i] * b[i];
+    }
+    return total;
+}
+
+static void scale_scalar(double *data, size_t n, double factor) {
+    for (size_t i = 0; i < n; ++i) {
+        data[i] *= factor;
+    }
+}
+
+static void add_scalar(double *a, const double *b, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        a[i] += b[i];
+    }
+}
+
+static void prefix_sum_scalar(double *data, size_t n, double carry) {
+    for (size_t i = 0; i < n; ++i) {
+        carry += data[i];
+        data[i] = carry;
+    }
+}
+
+#ifdef CLOXPP_X86_SIMD
+
+// SSE2 is part of the x86-64 baseline so these need no runtime check
+
+static double sum_sse2(const double *data, size_t n) {
+    // Two accumulators so consecutive adds do not wait on each other
+    __m128d acc0 = _mm_setzero_pd();
+    __m128d acc1 = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        acc0 = _mm_add_pd(acc0, _mm_loadu_pd(data + i));
+        acc1 = _mm_add_pd(acc1, _mm_loadu_pd(data + i + 2));
+    }
+    double lanes[2];
+    _mm_storeu_pd(lanes, _mm_add_pd(acc0, acc1));
+    return lanes[0] + lanes[1] + sum_scalar(data + i, n - i);
+}
+
+static double min_sse2(const double *data, size_t n) {
+    __m128d acc = _mm_set1_pd(data[0]);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        acc = _mm_min_pd(acc, _mm_loadu_pd(data + i));
+    }
+    double lanes[2];
+    _mm_storeu_pd(lanes, acc);
+    double result = std::min(lanes[0], lanes[1]);
+    return i < n ? std::min(result, data[i]) : result;
+}
+
+static double max_sse2(const double *data, size_t n) {
+    __m128d acc = _mm_set1_pd(data[0]);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        acc = _mm_max_pd(acc, _mm_loadu_pd(data + i));
+    }
+    double lanes[2];
+    _mm_storeu_pd(lanes, acc);
+    double result = std::max(lanes[0], lanes[1]);
+    return i < n ? std::max(result, data[i]) : result;
+}
+
+static double dot_sse2(const double *a, const double *b, size_t n) {
+    __m128d acc0 = _mm_setzero_pd();
+    __m128d acc1 = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        acc0 = _mm_add_pd(acc0, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+        acc1 = _mm_add_pd(acc1, _mm_mul_pd(_mm_loadu_pd(a + i + 2), _mm_loadu_pd(b + i + 2)));
+    }
+    double lanes[2];
+    _mm_storeu_pd(lanes, _mm_add_pd(acc0, acc1));
+    return lanes[0] + lanes[1] + dot_scalar(a + i, b + i, n - i);
+}
+
+static void scale_sse2(double *data, size_t n, double factor) {
+    __m128d k = _mm_set1_pd(factor);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        _mm_storeu_pd(data + i, _mm_mul_pd(_mm_loadu_pd(data + i), k));
+    }
+    scale_scalar(data + i, n - i, factor);
+}
+
+static void add_sse2(double *a, const double *b, size_t n) {
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        _mm_storeu_pd(a + i, _mm_add_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+    }
+    add_scalar(a + i, b + i, n - i);
+}
+
+static void prefix_sum_sse2(double *data, size_t n) {
+    // We scan two values at a time and carry the running total in both lanes
+    __m128d carry = _mm_setzero_pd();
+    __m128d zero = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128d x = _mm_loadu_pd(data + i);
+        // [a, b] + [0, a] = [a, a + b]
+        x = _mm_add_pd(x, _mm_unpacklo_pd(zero, x));
+        x = _mm_add_pd(x, carry);
+        _mm_storeu_pd(data + i, x);
+        carry = _mm_unpackhi_pd(x, x);
+    }
+    prefix_sum_scalar(data + i, n - i, _mm_cvtsd_f64(carry));
+}
+
+// AVX versions, only called after checking the CPU supports them
+
+__attribute__((target("avx"))) static double sum_avx(const double *data, size_t n) {
+    __m256d acc0 = _mm256_setzero_pd();
+    __m256d acc1 = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        acc0 = _mm256_add_pd(acc0, _mm256_loadu_pd(data + i));
+        acc1 = _mm256_add_pd(acc1, _mm256_loadu_pd(data + i + 4));
+    }
+    double lanes[4];
+    _mm256_storeu_pd(lanes, _mm256_add_pd(acc0, acc1));
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]) + sum_scalar(data + i, n - i);
+}
+
+__attribute__((target("avx"))) static double min_avx(const double *data, size_t n) {
+    __m256d acc = _mm256_set1_pd(data[0]);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        acc = _mm256_min_pd(acc, _mm256_loadu_pd(data + i));
+    }
+    double lanes[4];
+    _mm256_storeu_pd(lanes, acc);
+    double result = std::min(std::min(lanes[0], lanes[1]), std::min(lanes[2], lanes[3]));
+    return i < n ? std::min(result, min_scalar(data + i, n - i)) : result;
+}
+
+__attribute__((target("avx"))) static double max_avx(const double *data, size_t n) {
+    __m256d acc = _mm256_set1_pd(data[0]);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        acc = _mm256_max_pd(acc, _mm256_loadu_pd(data + i));
+    }
+    double lanes[4];
+    _mm256_storeu_pd(lanes, acc);
+    double result = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+    return i < n ? std::max(result, max_scalar(data + i, n - i)) : result;
+}
+
+__attribute__((target("avx"))) static double dot_avx(const double *a, const double *b, size_t n) {
+    __m256d acc0 = _mm256_setzero_pd();
+    __m256d acc1 = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        acc0 = _mm256_add_pd(acc0, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+        acc1 = _mm256_add_pd(acc1,
+                             _mm256_mul_pd(_mm256_loadu_pd(a + i + 4), _mm256_loadu_pd(b + i + 4)));
+    }
+    double lanes[4];
+    _mm256_storeu_pd(lanes, _mm256_add_pd(acc0, acc1));
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]) + dot_scalar(a + i, b + i, n - i);
+}
+
+__attribute__((target("avx"))) static void scale_avx(double *data, size_t n, double factor) {
+    __m256d k = _mm256_set1_pd(factor);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm256_storeu_pd(data + i, _mm256_mul_pd(_mm256_loadu_pd(data + i), k));
+    }
+    scale_scalar(data + i, n - i, factor);
+}
+
+__attribute__((target("avx"))) static void add_avx(double *a, const double *b, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm256_storeu_pd(a + i, _mm256_add_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+    }
+    add_scalar(a + i, b + i, n - i);
+}
+
+// The in register scan needs cross lane permutes, which only AVX2 has
+__attribute__((target("avx2"))) static void prefix_sum_avx2(double *data, size_t n) {
+    __m256d carry = _mm256_setzero_pd();
+    __m256d zero = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d x = _mm256_loadu_pd(data + i);
+        // [a, b, c, d] + [0, a, b, c]
+        __m256d shifted = _mm256_permute4x64_pd(x, _MM_SHUFFLE(2, 1, 0, 0));
+        x = _mm256_add_pd(x, _mm256_blend_pd(shifted, zero, 0b0001));
+        // then + [0, 0, a, a + b]
+        shifted = _mm256_permute4x64_pd(x, _MM_SHUFFLE(1, 0, 0, 0));
+        x = _mm256_add_pd(x, _mm256_blend_pd(shifted, zero, 0b0011));
+        x = _mm256_add_pd(x, carry);
+        _mm256_storeu_pd(data + i, x);
+        carry = _mm256_permute4x64_pd(x, _MM_SHUFFLE(3, 3, 3, 3));
+    }
+    prefix_sum_scalar(data + i, n - i, _mm256_cvtsd_f64(carry));
+}
+
+#endif
+
+// The kernels we settled on for this CPU
+struct KernelTable {
+    double (*sum)(const double *, size_t);
+    double (*min)(const double *, size_t);
+    double (*max)(const double *, size_t);
+    double (*dot)(const double *, const double *, size_t);
+    void (*scale)(double *, size_t, double);
+    void (*add)(double *, const double *, size_t);
+    void (*prefix_sum)(double *, size_t);
+};
+
+// We probe the CPU once, the first time any kernel runs
+static const KernelTable &kernel_table() {
+    static const KernelTable table = [] {
+#ifdef CLOXPP_X86_SIMD
+        KernelTable table{sum_sse2,   min_sse2, max_sse2,       dot_sse2,
+                          scale_sse2, add_sse2, prefix_sum_sse2};
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx")) {
+            table.sum = sum_avx;
+            table.min = min_avx;
+            table.max = max_avx;
+            table.dot = dot_avx;
+            table.scale = scale_avx;
+            table.add = add_avx;
+        }
+        if (__builtin_cpu_supports("avx2")) {
+            table.prefix_sum = prefix_sum_avx2;
+        }
+        return table;
+#else
+        return KernelTable{sum_scalar,   min_scalar, max_scalar,
+                           dot_scalar,   scale_scalar, add_scalar,
+                           [](double *data, size_t n) { prefix_sum_scalar(data, n, 0.0); }};
+#endif
+    }();
+    return table;
+}
+
+double kernels::sum(span<const double> values) {
+    return kernel_table().sum(values.data(), values.size());
+}
+
+// min and max expect at least one value, the natives check for that
+double kernels::min(span<const double> values) {
+    return kernel_table().min(values.data(), values.size());
+}
+
+double kernels::max(span<const double> values) {
+    return kernel_table().max(values.data(), values.size());
+}
+
+double kernels::dot(span<const double> a, span<const double> b) {
+    return kernel_table().dot(a.data(), b.data(), std::min(a.size(), b.size()));
+}
+
+void kernels::scale(span<double> values, double factor) {
+    kernel_table().scale(values.data(), values.size(), factor);
+}
+
+void kernels::add(span<double> a, span<const double> b) {
+    kernel_table().add(a.data(), b.data(), std::min(a.size(), b.size()));
+}
+
+void kernels::prefix_sum(span<double> values) {
+    kernel_table().prefix_sum(values.data(), values.size());
+}
+
+// Helpers to unpack native arguments, bad arguments become Lox runtime errors
+
+static NumberArray &as_array(const std::any &value) {
+    if (auto *array = std::any_cast<std::shared_ptr<NumberArray>>(&value)) {
+        return **array;
+    }
+    throw NativeError("Expected a number array.");
+}
+
+static double as_number(const std::any &value) {
+    if (auto *number = std::any_cast<double>(&value)) {
+        return *number;
+    }
+    throw NativeError("Expected a number.");
+}
+
+// Indices and sizes have to be whole numbers an array could hold, indices also
+// have to be in range
+static size_t as_size(const std::any &value) {
+    double number = as_number(value);
+    if (!std::isfinite(number) || number < 0 || std::floor(number) != number) {
+        throw NativeError("Expected a non-negative integer.");
+    }
+    if (number > static_cast<double>(std::vector<double>().max_size())) {
+        throw NativeError("Array size too large.");
+    }
+    return static_cast<size_t>(number);
+}
+
+// Function to run an allocating operation, running out of memory is the script's
+// error rather than ours
+template <typename F> static auto allocating(F &&operation) {
+    try {
+        return operation();
+    } catch (const std::bad_alloc &) {
+        throw NativeError("Out of memory.");
+    }
+}
+
+static size_t as_index(const std::any &value, const NumberArray &array) {
+    size_t index = as_size(value);
+    if (index >= array.values.size()) {
+        throw NativeError("Index out of range.");
+    }
+    return index;
+}
+
+static const NumberArray &non_empty(const NumberArray &array) {
+    if (array.values.empty()) {
+        throw NativeError("Array is empty.");
+    }
+    return array;
+}
+
+static const NumberArray &same_size(const NumberArray &a, const NumberArray &b) {
+    if (a.values.size() != b.values.size()) {
+        throw NativeError("Arrays must have the same length.");
+    }
+    return b;
+}
+
+void CppLox::define_number_array_natives(NativeRegistry &registry) {
+    registry.define("NumberArray", 1, [](span<const std::any> args) -> std::any {
+        size_t size = as_size(args[0]);
+        return allocating([size] { return std::make_shared<NumberArray>(size); });
+    });
+    registry.define("array_length", 1, [](span<const std::any> args) -> std::any {
+        return static_cast<double>(as_array(args[0]).values.size());
+    });
+    registry.define("array_get", 2, [](span<const std::any> args) -> std::any {
+        NumberArray &array = as_array(args[0]);
+        return array.values[as_index(args[1], array)];
+    });
+    registry.define("array_set", 3, [](span<const std::any> args) -> std::any {
+        NumberArray &array = as_array(args[0]);
+        array.values[as_index(args[1], array)] = as_number(args[2]);
+        return nullptr;
+    });
+    registry.define("array_push", 2, [](span<const std::any> args) -> std::any {
+        NumberArray &array = as_array(args[0]);
+        double value = as_number(args[1]);
+        allocating([&] { array.values.push_back(value); });
+        return nullptr;
+    });
+
+    // Bulk kernels
+    registry.define("array_sum", 1, [](span<const std::any> args) -> std::any {
+        return kernels::sum(as_array(args[0]).values);
+    });
+    registry.define("array_min", 1, [](span<const std::any> args) -> std::any {
+        return kernels::min(non_empty(as_array(args[0])).values);
+    });
+    registry.define("array_max", 1, [](span<const std::any> args) -> std::any {
+        return kernels::max(non_empty(as_array(args[0])).values);
+    });
+    registry.define("array_dot", 2, [](span<const std::any> args) -> std::any {
+        NumberArray &a = as_array(args[0]);
+        return kernels::dot(a.values, same_size(a, as_array(args[1])).values);
+    });
+    registry.define("array_scale", 2, [](span<const std::any> args) -> std::any {
+        kernels::scale(as_array(args[0]).values, as_number(args[1]));
+        return nullptr;
+    });
+    registry.define("array_add", 2, [](span<const std::any> args) -> std::any {
+        NumberArray &a = as_array(args[0]);
+        kernels::add(a.values, same_size(a, as_array(args[1])).values);
+        return nullptr;
+    });
+    registry.define("array_prefix_sum", 1, [](span<const std::any> args) -> std::any {
+        kernels::prefix_sum(as_array(args[0]).values);
+        return nullptr;
+    });
+}
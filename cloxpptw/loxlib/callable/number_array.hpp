@@ -0,0 +1,45 @@
+#ifndef NUMBER_ARRAY_HPP
+#define NUMBER_ARRAY_HPP
+
+#include "callable/native_functions.hpp"
+
+#include <cstddef>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace CppLox {
+
+/*
+ * Contiguous array of numbers exposed to Lox through natives. Scripts only see
+ * an opaque handle, every operation goes through a native function so bulk work
+ * like sums and dot products runs at native speed.
+ */
+struct NumberArray {
+    NumberArray(std::size_t size) : values(size, 0.0) {}
+    std::string to_string() const { return "<array " + std::to_string(values.size()) + ">"; }
+    std::vector<double> values;
+};
+
+/*
+ * Bulk kernels over contiguous doubles. On x86 we pick AVX/AVX2 versions at
+ * runtime when the CPU has them and use SSE2 otherwise, other targets get the
+ * scalar loops. Reductions keep several partial sums, so results may differ
+ * from a left to right scalar loop in the last bits.
+ */
+namespace kernels {
+double sum(std::span<const double> values);
+double min(std::span<const double> values);
+double max(std::span<const double> values);
+double dot(std::span<const double> a, std::span<const double> b);
+void scale(std::span<double> values, double factor);
+void add(std::span<double> a, std::span<const double> b);
+void prefix_sum(std::span<double> values);
+} // namespace kernels
+
+// Function to register the NumberArray constructor and array_* natives
+void define_number_array_natives(NativeRegistry &registry);
+
+} // namespace CppLox
+
+#endif
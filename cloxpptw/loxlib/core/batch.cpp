@@ -0,0 +1,121 @@
+#include "core/batch.hpp"
+
+#include "batch.hpp"
+#include "core/lox.hpp"
+#include "utils/native_stack.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+using namespace CppLox;
+using std::string;
+using std::vector;
+
+// If no job count is given we use every core
+BatchRunner::BatchRunner(InterpreterConfig config, unsigned jobs) : config(config), jobs(jobs) {
+    if (this->jobs == 0) {
+        this->jobs = std::max(1u, std::thread::hardware_concurrency());
+    }
+}
+
+// Main logic for the worker pool
+void BatchRunner::run(const vector<string> &scripts,
+                      const std::function<void(const BatchResult &)> &report) {
+    // Workers claim scripts by bumping a shared index
+    std::atomic<std::size_t> next_script{0};
+
+    // Finished results wait here until everything before them has been reported
+    std::mutex mutex;
+    vector<std::optional<BatchResult>> results(scripts.size());
+    std::size_t next_report = 0;
+
+    auto worker = [&]() {
+        for (std::size_t i = next_script++; i < scripts.size(); i = next_script++) {
+            BatchResult result;
+            // An exception escaping this thread would terminate the whole batch, so
+            // it only fails the script that raised it
+            try {
+                result = run_one(scripts[i]);
+            } catch (const std::exception &error) {
+                result.path = scripts[i];
+                result.diagnostics = string("Error: ") + error.what() + "\n";
+                result.exit_status = 70;
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            results[i] = std::move(result);
+            while (next_report < results.size() && results[next_report]) {
+                report(*results[next_report]);
+                // We do not need to hold on to output we already reported
+                results[next_report].reset();
+                ++next_report;
+            }
+        }
+    };
+
+    // Every worker gets a stack sized for the configured call depth when the pool
+    // starts, the scripts then run on it directly. If the OS runs out of room for
+    // more stacks we carry on with the workers we got
+    std::size_t stack_bytes = stack_size_for_depth(config.max_call_depth);
+    std::size_t count = std::min<std::size_t>(jobs, std::max<std::size_t>(1, scripts.size()));
+    vector<NativeThread> workers;
+    for (std::size_t i = 0; i < count; ++i) {
+        try {
+            workers.emplace_back(stack_bytes, worker);
+        } catch (const std::runtime_error &) {
+            if (workers.empty()) {
+                throw;
+            }
+            break;
+        }
+    }
+    for (NativeThread &thread : workers) {
+        thread.join();
+    }
+}
+
+// Function to run a single script with its own interpreter and captured output
+BatchResult BatchRunner::run_one(const string &path) {
+    BatchResult result;
+    result.path = path;
+
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        result.diagnostics = "Error: Could not open file " + path + "\n";
+        result.exit_status = 66;
+        return result;
+    }
+    string code((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    // Prints and errors go to buffers owned by this script alone
+    std::ostringstream output;
+    std::ostringstream diagnostics;
+    StreamSink sink(diagnostics);
+    InterpreterConfig script_config = config;
+    script_config.out = &output;
+    // Profiles from concurrent scripts would all land in the same file, and pool
+    // stats would interleave on stderr
+    script_config.profile = false;
+    script_config.pool_stats = false;
+
+    switch (Lox::execute(std::move(code), script_config, sink)) {
+    case RunResult::OK:
+        result.exit_status = 0;
+        break;
+    case RunResult::COMPILE_ERROR:
+        result.exit_status = 65;
+        break;
+    case RunResult::RUNTIME_ERROR:
+        result.exit_status = 70;
+        break;
+    }
+    result.output = output.str();
+    result.diagnostics = diagnostics.str();
+    return result;
+}
@@ -0,0 +1,46 @@
+#ifndef BATCH_HPP
+#define BATCH_HPP
+
+#include "core/interpreter.hpp"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace CppLox {
+
+// What we captured from running a single script of a batch
+struct BatchResult {
+    std::string path;
+    // Everything the script printed
+    std::string output;
+    // Compile and runtime errors the script reported
+    std::string diagnostics;
+    // 0 on success, 65 for compile errors, 66 if the file could not be read and
+    // 70 for runtime errors
+    int exit_status = 0;
+};
+
+/*
+ * Runs many scripts in one process on a pool of worker threads. Every script
+ * gets its own Program, Interpreter, error state and output buffer, while the
+ * read only front end tables like the keyword map are shared by all of them.
+ */
+class BatchRunner {
+    InterpreterConfig config;
+    unsigned jobs;
+
+  public:
+    BatchRunner(InterpreterConfig config, unsigned jobs);
+
+    // Function to run every script, results are handed to report in input order
+    void run(const std::vector<std::string> &scripts,
+             const std::function<void(const BatchResult &)> &report);
+
+  private:
+    BatchResult run_one(const std::string &path);
+};
+
+} // namespace CppLox
+
+#endif
@@ -2,6 +2,7 @@
 
 #include "interpreter.hpp"
 
+#include <atomic>
 #include <chrono>
 #include <cmath>
 #include <iostream>
@@ -17,13 +18,15 @@ using std::vector;
 // Constructor fo Interpreter
 // We construct/define all our global runtime parameters/native functions
 // here
-Interpreter::Interpreter() {
-    /*
-     * we define a variable named clock that stores a pointer to out Native Clock method
-     * we use a shared_ptr since they are much more forgiving than unique_ptrs when it comes to
-     * ownership
-     */
-    globals->define("clock", std::shared_ptr<NativeClock>{std::make_shared<NativeClock>()});
+Interpreter::Interpreter(InterpreterConfig config, DiagnosticSink &sink)
+    : errors(sink), config(config) {
+    // We start out with the builtin natives like clock
+    install(NativeRegistry::builtins());
+
+    // We only pay for the profiler when it was asked for
+    if (config.profile) {
+        profiler = std::make_unique<Profiler>();
+    }
 }
 
 /*
@@ -37,18 +40,35 @@ void Interpreter::interpret(const vector<shared_ptr<Stmt>> &stmts) {
             execute(stmt);
         }
     } catch (RuntimeError error) {
-        LoxError::runtime_error(error);
+        errors.runtime_error(error);
     }
 }
 
-// Function to resolve expressions
-void Interpreter::resolve(shared_ptr<Expr> expr, int depth) {
-    // We store the expression with its associated depth
-    locals[expr] = depth;
+// Function to make a registry's natives available to scripts
+void Interpreter::install(const NativeRegistry &registry) { registry.install(*globals); }
+
+// Function to expose a single C++ function to scripts
+void Interpreter::define_native(std::string name, int arity, NativeFn fn) {
+    globals->define(name, std::make_shared<NativeFunction>(name, arity, std::move(fn)));
+}
+
+// Function to run a compiled program against our globals
+void Interpreter::execute(const Program &program) {
+    // We never run a program the front end rejected
+    if (program.had_error) {
+        return;
+    }
+    ResolutionScope scope(resolution, program.resolution.get());
+    interpret(program.stmts);
 }
 
 // Helper function to execute statemtent
-void Interpreter::execute(shared_ptr<Stmt> stmt) { stmt->accept(*this); }
+void Interpreter::execute(shared_ptr<Stmt> stmt) {
+    if (profiler) {
+        profiler->hit_line(stmt->line);
+    }
+    stmt->accept(*this);
+}
 
 // Helper method to send the expression back to visitor
 // implementation
@@ -61,9 +81,9 @@ any Interpreter::evaluate(shared_ptr<Expr> expr) { return expr->accept(*this); }
  * iteration is finished
  */
 void Interpreter::execute_block(const vector<shared_ptr<Stmt>> &stmts,
-                                shared_ptr<Environment> env) {
+                                Ref<Environment> env) {
     // We first need to store the first environment
-    shared_ptr<Environment> previous = this->environment;
+    Ref<Environment> previous = this->environment;
 
     // We transfer ownership of the passed in environment
     this->environment = env;
@@ -93,7 +113,7 @@ any Interpreter::visitClassStmt(shared_ptr<Class> stmt) {
         // We evaluate and store the result, should be a LoxClass object
         superclass = evaluate(stmt->superclass);
         // We then test if its a LoxClass object, and throw an error if not
-        if (superclass.type() != typeid(shared_ptr<LoxClass>)) {
+        if (superclass.type() != typeid(Ref<LoxClass>)) {
             throw RuntimeError(stmt->superclass->name, "Superclass must be a class.");
         }
     }
@@ -106,35 +126,40 @@ any Interpreter::visitClassStmt(shared_ptr<Class> stmt) {
         // We evaluate and store the result, should be a LoxClass object
         superclass = evaluate(stmt->superclass);
         // We then test if its a LoxClass object, and throw an error if not
-        if (superclass.type() != typeid(shared_ptr<LoxClass>)) {
+        if (superclass.type() != typeid(Ref<LoxClass>)) {
             throw RuntimeError(stmt->superclass->name, "Superclass must be a class.");
         }
         // We then store a reference to the superclass
-        environment = std::make_shared<Environment>(environment);
+        environment = make_ref<Environment>(environment);
         environment->define("super", superclass);
     }
 
     // We create a map to store our methods
-    std::map<string, shared_ptr<LoxFunction>> methods;
+    std::map<string, Ref<LoxFunction>> methods;
 
     // We iterate over each method in the Class methods vector
     for (shared_ptr<Function> method : stmt->methods) {
         // We create a function for each method
-        shared_ptr<LoxFunction> function =
-            std::make_shared<LoxFunction>(method, environment, method->name.lexeme == "init");
+        Ref<LoxFunction> function = make_ref<LoxFunction>(
+            method, environment, method->name.lexeme == "init", resolution->shared_from_this());
         // We then add it to the map
         methods[method->name.lexeme] = function;
     }
 
     // We initialize our superclass object as nullptr
-    std::shared_ptr<LoxClass> superklass = nullptr;
+    Ref<LoxClass> superklass = nullptr;
     // We can then try to cast if the type id matches a LoxClass
-    if (superclass.type() == typeid(std::shared_ptr<LoxClass>)) {
-        superklass = std::any_cast<std::shared_ptr<LoxClass>>(superclass);
+    if (superclass.type() == typeid(Ref<LoxClass>)) {
+        superklass = std::any_cast<Ref<LoxClass>>(superclass);
     }
 
+    // We look up the fields the resolver found in the class's init method
+    static const vector<string> no_fields;
+    auto init_fields = resolution->class_fields.find(stmt);
     // We create a new LoxClass class
-    shared_ptr<LoxClass> klass = std::make_shared<LoxClass>(stmt->name.lexeme, superklass, methods);
+    Ref<LoxClass> klass = make_ref<LoxClass>(
+        stmt->name.lexeme, superklass, methods,
+        init_fields != resolution->class_fields.end() ? init_fields->second : no_fields);
 
     // We do one final check to ensure superklass is not a nullptr and return
     // to the enclosing environment
@@ -165,7 +190,7 @@ any Interpreter::visitReturnStmt(shared_ptr<ReturnStmt> stmt) {
 // Function to handle blockstm logic
 any Interpreter::visitBlockStmt(shared_ptr<Block> stmt) {
     // We move ownership since we cannot copy shared_ptrs
-    execute_block(std::move(stmt->stmts), std::make_shared<Environment>(environment));
+    execute_block(std::move(stmt->stmts), make_ref<Environment>(environment));
     return {};
 }
 
@@ -180,7 +205,12 @@ any Interpreter::visitExpressionStmt(shared_ptr<ExpressionStmt> stmt) {
 any Interpreter::visitFunctionStmt(shared_ptr<Function> stmt) {
     // we create our function by passing in the statements and current environment
     // as the function is declared
-    shared_ptr<LoxFunction> function = std::make_shared<LoxFunction>(stmt, environment, false);
+    Ref<LoxFunction> function =
+        make_ref<LoxFunction>(stmt, environment, false, resolution->shared_from_this());
+    // Pure functions get a result cache when memoization is turned on
+    if (config.memoize && resolution->pure_functions.contains(stmt)) {
+        function->enable_memo();
+    }
     // we then define the function in the environemt
     environment->define(stmt->name.lexeme, function);
     return {};
@@ -191,7 +221,7 @@ any Interpreter::visitPrintStmt(shared_ptr<Print> stmt) {
     // We evaluate the expression and store temporarily
     any value = evaluate(stmt->expr);
     // We then display the value, the variable is destroyed after leaving scope
-    std::cout << make_string(value) << std::endl;
+    *config.out << make_string(value) << std::endl;
     // We then return an empty std::any{}
     return {};
 }
@@ -375,15 +405,33 @@ any Interpreter::visitGetExpr(shared_ptr<Get> expr) {
     // We first evaluate and store the underlying object
     std::any object = evaluate(expr->object);
     // We test if the object is a LoxInstance
-    if (object.type() == typeid(shared_ptr<LoxInstance>)) {
+    if (object.type() == typeid(Ref<LoxInstance>)) {
         // If so we return the value stored in the objects field
         // We need to unwrap the std::any object first however
-        return std::any_cast<std::shared_ptr<LoxInstance>>(object)->get(expr->name);
+        Ref<LoxInstance> &instance = std::any_cast<Ref<LoxInstance> &>(object);
+        return instance->get(expr->name, slot_for(expr->site, expr->name, *instance->klass));
     }
 
     throw RuntimeError(expr->name, "Only instances have properties.");
 }
 
+// Function to resolve a property to its field slot once per access site and
+// class, so accesses and method lookups skip the scan of the layout
+int Interpreter::slot_for(std::size_t site, const Token &name, const LoxClass &klass) {
+    std::atomic<std::uint64_t> &entry = resolution->slot_cache[site];
+    std::uint64_t cached = entry.load(std::memory_order_relaxed);
+    if (cached >> Resolution::SLOT_BITS == klass.id) {
+        return static_cast<int>(cached & Resolution::SLOT_MASK) - 1;
+    }
+    int slot = klass.slot_of(name.lexeme);
+    // Layouts too big for the slot bits just miss every time
+    auto stored = static_cast<std::uint64_t>(slot + 1);
+    if (stored <= Resolution::SLOT_MASK) {
+        entry.store(klass.id << Resolution::SLOT_BITS | stored, std::memory_order_relaxed);
+    }
+    return slot;
+}
+
 // Function to handle logical and, or operations
 any Interpreter::visitLogicalExpr(shared_ptr<Logical> expr) {
     // we first evaluate and store the left expressions value
@@ -418,29 +466,29 @@ any Interpreter::visitConditonalExpr(std::shared_ptr<Condtional> expr) {
         return evaluate(expr->false_expr);
     }
     // Not sure how to handle errors here so this will be a placeholder for now
-    LoxError::error(expr->op, "Improper use.");
+    errors.error(expr->op, "Improper use.");
 }
 
 // Function to interpret super expressions
 any Interpreter::visitSuperExpr(shared_ptr<Super> expr) {
     // We return the distance to the expression
-    int distance = locals[expr];
+    int distance = resolution->locals.at(expr);
     auto val = environment->get_at(distance, "super");
 
     // We then create a pointer to a LoxClass at the given distance
-    shared_ptr<LoxClass> superclass =
-        std::any_cast<shared_ptr<LoxClass>>(environment->get_at(distance, "super"));
+    Ref<LoxClass> superclass =
+        std::any_cast<Ref<LoxClass>>(environment->get_at(distance, "super"));
 
     /*
      * We then create an instance of 'this' with a bit of a hack
      * since we control the layout of the environments 'this' and 'super' are always
      * in the same one, so we reach into the same map and retrive 'this'
      */
-    shared_ptr<LoxInstance> object =
-        std::any_cast<shared_ptr<LoxInstance>>(environment->get_at(distance - 1, "this"));
+    Ref<LoxInstance> object =
+        std::any_cast<Ref<LoxInstance>>(environment->get_at(distance - 1, "this"));
 
     // We can now look up and bind the method starting at the super class
-    shared_ptr<LoxFunction> method = superclass->find_method(expr->method.lexeme);
+    Ref<LoxFunction> method = superclass->find_method(expr->method.lexeme);
 
     // If the method is a nullptr, we throw an error
     if (method == nullptr) {
@@ -463,14 +511,15 @@ any Interpreter::visitSetExpr(shared_ptr<Set> expr) {
     std::any object = evaluate(expr->object);
 
     // If the object is not a Lox instance we toss an errors
-    if (object.type() != typeid(shared_ptr<LoxInstance>)) {
+    if (object.type() != typeid(Ref<LoxInstance>)) {
         throw RuntimeError(expr->name, "Only instances have fields.");
     }
 
     // If our check passes, we evaluate the expression
     std::any value = evaluate(expr->value);
     // Then invoke the setter method and return the value
-    std::any_cast<std::shared_ptr<LoxInstance>>(object)->set(expr->name, value);
+    Ref<LoxInstance> &instance = std::any_cast<Ref<LoxInstance> &>(object);
+    instance->set(expr->name, value, slot_for(expr->site, expr->name, *instance->klass));
     return value;
 }
 
@@ -479,29 +528,38 @@ any Interpreter::visitCallExpr(shared_ptr<Call> expr) {
     // we evaluate our calle and save it
     any callee = evaluate(expr->callee);
 
-    // we initialize a vector of any to store our args
-    vector<any> args;
-    // we iterate over the vector of Expr args
+    // We push our args on the argument stack, once it has warmed up this does not
+    // allocate, nested calls in the arguments push and pop above our frame
+    ArgumentFrame frame{argument_stack};
     // we make sure its const ref so that we dont deplete the vector too quickly
     for (const shared_ptr<Expr> &arg : expr->args) {
-        args.push_back(evaluate(arg));
-    }
-
-    // We forward declare our lox callable object
-    shared_ptr<LoxCallable> callable;
-
-    // We add a check to ensure our callable is actually a Function type
-    if (callee.type() == typeid(shared_ptr<LoxFunction>)) {
-        // If we pass our test we can cast to a LoxFunction
-        // This is necessary to unwrap the any object
-        callable = std::any_cast<shared_ptr<LoxFunction>>(std::move(callee));
-        // We add a check for our single native function
-    } else if (callee.type() == typeid(shared_ptr<NativeClock>)) {
-        callable = std::any_cast<std::shared_ptr<NativeClock>>(std::move(callee));
-    } else if (callee.type() == typeid(shared_ptr<LoxClass>)) {
-        // Or a to a LoxClass
-        // Similarly we need to unwrap the any object
-        callable = std::any_cast<shared_ptr<LoxClass>>(std::move(callee));
+        argument_stack.push_back(evaluate(arg));
+    }
+    // The stack may have grown while we evaluated, so we only look at it now
+    std::span<const any> args = frame.arguments();
+
+    /*
+     * Natives take the fast path, the pointer form of any_cast only compares the
+     * stored type and we call straight into the C++ function without copying the
+     * shared_ptr or going through a virtual call
+     */
+    if (auto *native = std::any_cast<shared_ptr<NativeFunction>>(&callee)) {
+        check_arity(expr->paren, (*native)->num_params, args.size());
+        try {
+            return (*native)->invoke(args);
+        } catch (const NativeError &error) {
+            // Natives do not know about tokens so we attach the call site here
+            throw RuntimeError(expr->paren, error.what());
+        }
+    }
+
+    // Otherwise our callee has to be a Lox function or a class, callee keeps it
+    // alive for the duration of the call
+    LoxCallable *callable = nullptr;
+    if (auto *function = std::any_cast<Ref<LoxFunction>>(&callee)) {
+        callable = function->get();
+    } else if (auto *klass = std::any_cast<Ref<LoxClass>>(&callee)) {
+        callable = klass->get();
     } else {
         // Otherwise we throw a runtime error
         throw RuntimeError(expr->paren, "Can only call functions and classes.");
@@ -509,14 +567,17 @@ any Interpreter::visitCallExpr(shared_ptr<Call> expr) {
 
     // We need to test our the callables arity to ensure the correct number of args are
     // passed
-    if (args.size() != callable->arity()) {
-        throw RuntimeError{expr->paren, "Expected " + std::to_string(callable->arity()) +
-                                            " arguments but got " + std::to_string(args.size()) +
-                                            "."};
+    check_arity(expr->paren, callable->arity(), args.size());
+
+    // We cap how deep calls can nest so runaway recursion turns into a Lox error
+    // instead of blowing through the native stack
+    if (call_depth >= config.max_call_depth) {
+        throw RuntimeError(expr->paren, "Stack overflow.");
     }
+    CallDepthGuard guard{call_depth};
 
     // we can then return a call to the callable with the arguments
-    return callable->call(*this, std::move(args));
+    return callable->call(*this, args);
 }
 
 // To evaluate we recursively evaluate
@@ -543,9 +604,9 @@ any Interpreter::visitVariableExpr(shared_ptr<Variable> expr) {
 // Helper method to search for an expression and variable in our environments
 void Interpreter::check_and_assign(shared_ptr<Assign> expr, any value) {
     // We first need to search the locals map for our expression
-    if (locals.contains(expr)) {
-        int distance = locals.at(expr);
-        environment->assign_at(distance, expr->name, value);
+    auto it = resolution->locals.find(expr);
+    if (it != resolution->locals.end()) {
+        environment->assign_at(it->second, expr->name, value);
     } else {
         globals->assign(expr->name, value);
     }
@@ -554,9 +615,9 @@ void Interpreter::check_and_assign(shared_ptr<Assign> expr, any value) {
 // Overload for variable search
 void Interpreter::check_and_assign(shared_ptr<PreFixOp> expr, any value) {
     // We first need to search the locals map for our expression
-    if (locals.contains(expr)) {
-        int distance = locals.at(expr);
-        environment->assign_at(distance, expr->name, value);
+    auto it = resolution->locals.find(expr);
+    if (it != resolution->locals.end()) {
+        environment->assign_at(it->second, expr->name, value);
     } else {
         globals->assign(expr->name, value);
     }
@@ -604,6 +665,14 @@ bool Interpreter::is_equal(const any &me, const any &you) {
     return false;
 }
 
+// Function to make sure a call passes as many arguments as the callee expects
+void Interpreter::check_arity(const Token &paren, int arity, std::size_t count) {
+    if (count != static_cast<std::size_t>(arity)) {
+        throw RuntimeError{paren, "Expected " + std::to_string(arity) + " arguments but got " +
+                                      std::to_string(count) + "."};
+    }
+}
+
 // Function to test for numerical types, unary ops
 void Interpreter::check_num_operand(const Token &op, const any &operand) {
     if (operand.type() == typeid(double))
@@ -638,14 +707,23 @@ string Interpreter::make_string(const any &object) {
         return std::any_cast<bool>(object) ? "true" : "false";
     }
 
-    if (object.type() == typeid(std::shared_ptr<LoxFunction>)) {
-        return std::any_cast<std::shared_ptr<LoxFunction>>(object)->to_string();
+    if (object.type() == typeid(Ref<LoxFunction>)) {
+        return std::any_cast<Ref<LoxFunction>>(object)->to_string();
+    }
+    if (object.type() == typeid(Ref<LoxClass>)) {
+        return std::any_cast<Ref<LoxClass>>(object)->to_string();
+    }
+    if (object.type() == typeid(Ref<LoxInstance>)) {
+        return std::any_cast<Ref<LoxInstance>>(object)->to_string();
+    }
+    if (object.type() == typeid(std::shared_ptr<NativeFunction>)) {
+        return std::any_cast<std::shared_ptr<NativeFunction>>(object)->to_string();
     }
-    if (object.type() == typeid(std::shared_ptr<LoxClass>)) {
-        return std::any_cast<std::shared_ptr<LoxClass>>(object)->to_string();
+    if (object.type() == typeid(std::shared_ptr<NumberArray>)) {
+        return std::any_cast<std::shared_ptr<NumberArray>>(object)->to_string();
     }
-    if (object.type() == typeid(std::shared_ptr<LoxInstance>)) {
-        return std::any_cast<std::shared_ptr<LoxInstance>>(object)->to_string();
+    if (object.type() == typeid(std::shared_ptr<LoxMap>)) {
+        return std::any_cast<std::shared_ptr<LoxMap>>(object)->to_string();
     }
 
     return "Error in make_string: object type not recognized.";
@@ -654,9 +732,9 @@ string Interpreter::make_string(const any &object) {
 // Function to look up variables
 any Interpreter::variable_lookup(Token name, shared_ptr<Expr> expr) {
     // We search the map using find and return an iterator of positions
-    auto it = locals.find(expr);
+    auto it = resolution->locals.find(expr);
     // We test to see if the distance is found in the locals map
-    if (it != locals.end()) {
+    if (it != resolution->locals.end()) {
         // If it is, we return it from the environment
         return environment->get_at(it->second, name.lexeme);
     } else {
@@ -8,17 +8,41 @@
 #include "callable/lox_functions.hpp"
 #include "callable/lox_instance.hpp"
 #include "callable/native_functions.hpp"
+#include "callable/lox_map.hpp"
+#include "callable/number_array.hpp"
+#include "core/program.hpp"
 #include "runtime/environment.hpp"
+#include "runtime/profiler.hpp"
 #include "utils/error.hpp"
 #include "utils/tokens.hpp"
 
 #include <any>
+#include <iostream>
 #include <memory>
+#include <set>
 #include <stdexcept>
 #include <vector>
 
 namespace CppLox {
 
+class LoxClass;
+
+// Runtime knobs for the interpreter, these are set from the command line
+struct InterpreterConfig {
+    // Maximum number of nested Lox calls before we report a stack overflow
+    std::size_t max_call_depth = 10000;
+    // Cache the results of functions the purity analysis proves pure
+    bool memoize = false;
+    // Record per function timings and per line hit counts
+    bool profile = false;
+    // Where the folded stacks are written when profiling
+    std::string profile_path = "cloxpp.folded";
+    // Report how often environments came from the free list instead of malloc
+    bool pool_stats = false;
+    // Where print statements write, the batch runner captures it per script
+    std::ostream *out = &std::cout;
+};
+
 // We inherit the ExprVisitor class so now we need to override each visit method
 class Interpreter : ExprVisitor, StmtVisitor {
     // We make LoxFunction a friend class so we can throw it the return value
@@ -28,25 +52,79 @@ class Interpreter : ExprVisitor, StmtVisitor {
         std::any value;
     };
 
+    // RAII helper to track how deep we are in Lox calls, the count is restored
+    // even when we unwind through a Return or a RuntimeError
+    struct CallDepthGuard {
+        CallDepthGuard(std::size_t &depth) : depth(depth) { ++depth; }
+        ~CallDepthGuard() { --depth; }
+        std::size_t &depth;
+    };
+
+    // RAII helper that owns the arguments one call pushes on the argument stack,
+    // they are popped again however the call ends
+    struct ArgumentFrame {
+        ArgumentFrame(std::vector<std::any> &stack) : stack(stack), base(stack.size()) {}
+        ~ArgumentFrame() {
+            stack.erase(stack.begin() + static_cast<std::ptrdiff_t>(base), stack.end());
+        }
+        // Function to view this frame's arguments, only valid until the next push
+        std::span<const std::any> arguments() const {
+            return std::span<const std::any>(stack).subspan(base);
+        }
+        std::vector<std::any> &stack;
+        std::size_t base;
+    };
+
+    // RAII helper to evaluate against another program's resolution, a function
+    // body has to be looked up in the program that declared it
+    struct ResolutionScope {
+        ResolutionScope(const Resolution *&current, const Resolution *next)
+            : current(current), previous(current) {
+            current = next;
+        }
+        ~ResolutionScope() { current = previous; }
+        const Resolution *&current;
+        const Resolution *previous;
+    };
+
   public:
-    std::shared_ptr<Environment> globals = std::make_shared<Environment>();
-    std::map<std::shared_ptr<Expr>, int> locals;
+    Ref<Environment> globals = make_ref<Environment>();
+    // Call profiler, nullptr unless profiling was requested
+    std::unique_ptr<Profiler> profiler;
+    // Runtime error state for this interpreter alone
+    LoxError errors;
 
   private:
-    std::shared_ptr<Environment> environment = globals;
+    Ref<Environment> environment = globals;
+    InterpreterConfig config;
+    // Resolution of the program we are currently running
+    const Resolution *resolution = nullptr;
+    // Number of Lox calls currently on the stack
+    std::size_t call_depth = 0;
+    // Arguments of the calls being set up, shared so calls do not allocate
+    std::vector<std::any> argument_stack;
+    // Function to find the slot of a property access, -1 if it is not in the layout
+    int slot_for(std::size_t site, const Token &name, const LoxClass &klass);
 
   public:
-    Interpreter();
+    Interpreter(InterpreterConfig config = {}, DiagnosticSink &sink = stderr_sink());
 
-    void interpret(const std::vector<std::shared_ptr<Stmt>> &stmts);
-    void resolve(std::shared_ptr<Expr> expr, int depth);
-    void execute(std::shared_ptr<Stmt> stmt);
-    void execute_block(const std::vector<std::shared_ptr<Stmt>> &stmts,
-                       std::shared_ptr<Environment> env);
-    std::any evaluate(std::shared_ptr<Expr> expr);
+    // Functions for embedders to expose C++ functions to scripts
+    void install(const NativeRegistry &registry);
+    void define_native(std::string name, int arity, NativeFn fn);
+
+    // Function to run a compiled program, globals carry over between calls. This
+    // is the only way in, every statement and expression needs the resolution
+    // of the program it came from
+    void execute(const Program &program);
     bool repl{false};
 
   private:
+    void execute(std::shared_ptr<Stmt> stmt);
+    void execute_block(const std::vector<std::shared_ptr<Stmt>> &stmts,
+                       Ref<Environment> env);
+    std::any evaluate(std::shared_ptr<Expr> expr);
+    void interpret(const std::vector<std::shared_ptr<Stmt>> &stmts);
     std::any visitClassStmt(std::shared_ptr<Class> stmt) override;
     std::any visitReturnStmt(std::shared_ptr<ReturnStmt> stmt) override;
     std::any visitBlockStmt(std::shared_ptr<Block> stmt) override;
@@ -74,6 +152,7 @@ class Interpreter : ExprVisitor, StmtVisitor {
 
     void check_and_assign(std::shared_ptr<Assign> expr, std::any value);
     void check_and_assign(std::shared_ptr<PreFixOp> expr, std::any value);
+    void check_arity(const Token &paren, int arity, std::size_t count);
     bool is_truthy(const std::any &object);
     bool is_equal(const std::any &me, const std::any &you);
     void check_num_operand(const Token &op, const std::any &operand);
@@ -1,57 +1,106 @@
 #include "core/lox.hpp"
 
+#include "batch_scripts.hpp"
+#include "core/batch.hpp"
+
 using namespace CppLox;
 
 // The main logic for our Lox program, handles scanning, parsing, etc.
-void Lox::run(std::string code) {
-    // Create our Interpreter instance
-    CppLox::Interpreter interpreter;
-    // Create out Scanner instance
-    CppLox::Scanner scanner = CppLox::Scanner(code);
-    // Create tokens from source code
-    std::vector<CppLox::Token> tokens = scanner.scan_tokens();
-    CppLox::Parser parser = CppLox::Parser(tokens);
-    std::vector<std::shared_ptr<CppLox::Stmt>> stmts = parser.parse();
-
-    // Catch scanner and parser errors
-    if (CppLox::LoxError::had_error) {
-        return;
+RunResult Lox::run(std::string code, InterpreterConfig config, DiagnosticSink &sink) {
+    RunResult result = RunResult::OK;
+    // We run the whole pipeline on a stack sized for the configured call depth
+    // so deep recursion hits our "Stack overflow" error before the real one
+    run_on_native_stack(stack_size_for_depth(config.max_call_depth),
+                        [&]() { result = execute(std::move(code), config, sink); });
+    return result;
+}
+
+// Function to run the pipeline on the current thread
+RunResult Lox::execute(std::string code, InterpreterConfig config, DiagnosticSink &sink) {
+    // We run the front end over the source code
+    CppLox::Program program = CppLox::compile(std::move(code), sink);
+
+    // Catch scanner, parser and resolution errors
+    if (program.had_error) {
+        return RunResult::COMPILE_ERROR;
     }
 
-    // If there are no syntax errors we can run our resolver
-    CppLox::Resolver resolver = CppLox::Resolver(interpreter);
-    resolver.resolve(stmts);
+    // The pool counters belong to this thread, we only report what this run adds
+    PoolStats pool_before = Environment::pool().stats();
 
-    // We catch any resolution errors
-    if (CppLox::LoxError::had_error) {
-        return;
+    // Create our Interpreter instance and run the program
+    CppLox::Interpreter interpreter(config, sink);
+    interpreter.execute(program);
+
+    if (config.pool_stats) {
+        write_pool_stats(std::cerr, "Environment", Environment::pool().stats() - pool_before);
+    }
+
+    // We dump the profile once the script is done
+    if (interpreter.profiler) {
+        interpreter.profiler->write_report(std::cerr);
+        std::ofstream folded(config.profile_path);
+        interpreter.profiler->write_folded(folded);
     }
 
-    // We interpret the AST
-    interpreter.interpret(stmts);
+    if (interpreter.errors.had_RuntimeError) {
+        return RunResult::RUNTIME_ERROR;
+    }
+    return RunResult::OK;
 }
 
 // Function to wrap the run function around file contents
-void Lox::run_file(const std::string &filename) {
+void Lox::run_file(const std::string &filename, InterpreterConfig config) {
     // Slurp up file contents into a string
     std::string contents = slurp_file(filename);
 
-    // Run our main logic
-    Lox::run(contents);
-
-    // Catch any errors in our code
-    if (CppLox::LoxError::had_error) {
+    // Run our main logic, we only fail to start if the OS refuses the stack
+    RunResult result;
+    try {
+        result = Lox::run(contents, config);
+    } catch (const std::runtime_error &error) {
+        std::cerr << "Error: " << error.what() << std::endl;
         std::exit(EXIT_FAILURE);
     }
 
-    // Catch runtime errors in file
-    if (CppLox::LoxError::had_RuntimeError) {
+    // Catch any errors in our code, compile or runtime
+    if (result != RunResult::OK) {
         std::exit(EXIT_FAILURE);
     }
 }
 
+// Function to run a whole batch of scripts and report each one in order
+int Lox::run_batch(const std::string &source, unsigned jobs, InterpreterConfig config) {
+    std::vector<std::string> scripts = cloxpp::collect_batch_scripts(source);
+    if (scripts.empty()) {
+        std::cerr << "Error: No scripts found in " << source << std::endl;
+        return 66;
+    }
+
+    // Every script gets a header with its status, followed by what it printed
+    std::size_t failed = 0;
+    BatchRunner runner(config, jobs);
+    try {
+        runner.run(scripts, [&](const BatchResult &result) {
+            std::cout << "=== " << result.path << " (exit " << result.exit_status << ")\n"
+                      << result.output << result.diagnostics;
+            if (result.exit_status != 0) {
+                ++failed;
+            }
+        });
+    } catch (const std::runtime_error &error) {
+        // Not even one worker could get its stack
+        std::cerr << "Error: " << error.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << std::flush;
+
+    std::cerr << "Ran " << scripts.size() << " scripts, " << failed << " failed" << std::endl;
+    return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
 // Function for main REPL logic
-void Lox::run_prompt() {
+void Lox::run_prompt(InterpreterConfig config) {
     /*
      * We start by running the REPL in an infinite loop
      * We exit the loop as soon as exit() is used.
@@ -83,9 +132,12 @@ void Lox::run_prompt() {
 
             // Evaulate text contents
         } else {
-            run(code);
-            CppLox::LoxError::had_error = false;
-            CppLox::LoxError::had_RuntimeError = false;
+            // Every line gets fresh error state so we simply carry on
+            try {
+                run(code, config);
+            } catch (const std::runtime_error &error) {
+                std::cerr << "Error: " << error.what() << std::endl;
+            }
         }
     }
 }
@@ -2,10 +2,9 @@
 #define LOX_HPP
 
 #include "core/interpreter.hpp"
-#include "core/parser.hpp"
-#include "core/scanner.hpp"
-#include "runtime/resolver.hpp"
+#include "core/program.hpp"
 #include "utils/error.hpp"
+#include "utils/native_stack.hpp"
 
 #include <cstdlib>
 #include <fstream>
@@ -14,10 +13,20 @@
 
 namespace CppLox {
 
+// Outcome of running a piece of Lox code
+enum class RunResult { OK, COMPILE_ERROR, RUNTIME_ERROR };
+
 struct Lox {
-    static void run_file(const std::string &filename);
-    static void run_prompt();
-    static void run(std::string code);
+    static void run_file(const std::string &filename, InterpreterConfig config = {});
+    static void run_prompt(InterpreterConfig config = {});
+    static int run_batch(const std::string &source, unsigned jobs, InterpreterConfig config = {});
+    // Throws std::runtime_error if the OS refuses a stack that big
+    static RunResult run(std::string code, InterpreterConfig config = {},
+                         DiagnosticSink &sink = stderr_sink());
+    // Same as run but stays on the calling thread, which must already have a
+    // stack big enough for config.max_call_depth
+    static RunResult execute(std::string code, InterpreterConfig config = {},
+                             DiagnosticSink &sink = stderr_sink());
     static std::string slurp_file(const std::string &filename);
 };
 
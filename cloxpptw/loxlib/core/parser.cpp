@@ -8,8 +8,10 @@ using std::shared_ptr;
 using std::vector;
 
 // Constructor for Parser class
-// We take in a vector of tokens to consume
-Parser::Parser(vector<Token> tokens) { this->tokens = tokens; }
+// We take in a vector of tokens to consume and where to report errors
+Parser::Parser(vector<Token> tokens, LoxError &errors) : errors(errors) {
+    this->tokens = tokens;
+}
 
 // Function to parse code
 vector<shared_ptr<Stmt>> Parser::parse() {
@@ -23,20 +25,22 @@ vector<shared_ptr<Stmt>> Parser::parse() {
 
 // Function for handling declarations
 shared_ptr<Stmt> Parser::declaration() {
+    // We remember which line the declaration starts on
+    int line = peek().line;
     try {
         // We match a var keyword and return var_declaration
         if (match({TokenType::VAR})) {
-            return var_declaration();
+            return with_line(var_declaration(), line);
         }
 
         // We match a function declaration
         if (match({TokenType::FUN})) {
-            return function("function");
+            return with_line(function("function"), line);
         }
 
         // We match class declaration
         if (match({TokenType::CLASS})) {
-            return class_declaration();
+            return with_line(class_declaration(), line);
         }
 
         // By default we return a statement
@@ -103,32 +107,41 @@ shared_ptr<Stmt> Parser::var_declaration() {
 // Lox programs are a series of statements so
 // all scripts start here defined by our grammar rules
 shared_ptr<Stmt> Parser::statement() {
+    // We remember which line the statement starts on
+    int line = peek().line;
+
     // We have a match case for each keyword
     if (match({TokenType::IF}))
-        return if_statement();
+        return with_line(if_statement(), line);
     if (match({TokenType::PRINT})) {
-        return print_statement();
+        return with_line(print_statement(), line);
     }
 
     if (match({TokenType::WHILE})) {
-        return while_statement();
+        return with_line(while_statement(), line);
     }
 
     if (match({TokenType::RETURN})) {
-        return return_statement();
+        return with_line(return_statement(), line);
     }
 
     if (match({TokenType::FOR})) {
-        return for_statement();
+        return with_line(for_statement(), line);
     }
 
     if (match({TokenType::LEFT_BRACE})) {
         // We need to move ownership
-        return std::make_shared<Block>(block());
+        return with_line(std::make_shared<Block>(block()), line);
     }
 
     // If we dont reach the predefined stmt types return a base expression stmt
-    return expression_statement();
+    return with_line(expression_statement(), line);
+}
+
+// Helper to stamp a statement with the line it started on
+shared_ptr<Stmt> Parser::with_line(shared_ptr<Stmt> stmt, int line) {
+    stmt->line = line;
+    return stmt;
 }
 
 // Function to match if statement
@@ -180,6 +193,8 @@ shared_ptr<Stmt> Parser::while_statement() {
 
 // Logic for handling for statements
 shared_ptr<Stmt> Parser::for_statement() {
+    // The statements we desugar into are stamped with the line of the 'for'
+    int line = previous().line;
     // We consume the first parenethesis
     consume(TokenType::LEFT_PAREN, "Expect '(' after 'for'.");
 
@@ -190,10 +205,10 @@ shared_ptr<Stmt> Parser::for_statement() {
         initializer = nullptr;
         // if we match a var, we can add a variable declaration
     } else if (match({TokenType::VAR})) {
-        initializer = var_declaration();
+        initializer = with_line(var_declaration(), line);
         // otherwise, we just pass the expression
     } else {
-        initializer = expression_statement();
+        initializer = with_line(expression_statement(), line);
     }
 
     // We can now take our condition, we start with a nullptr
@@ -218,8 +233,11 @@ shared_ptr<Stmt> Parser::for_statement() {
     // We can now check if our increment is null
     // and replace our statement with a block instead
     if (increment != nullptr) {
-        body = std::make_shared<Block>(std::vector<std::shared_ptr<Stmt>>{
-            std::move(body), std::make_shared<ExpressionStmt>(std::move(increment))});
+        body = with_line(std::make_shared<Block>(std::vector<std::shared_ptr<Stmt>>{
+                             std::move(body),
+                             with_line(std::make_shared<ExpressionStmt>(std::move(increment)),
+                                       line)}),
+                         line);
     }
 
     // If the condition is nullptr we cram a true in to
@@ -228,13 +246,14 @@ shared_ptr<Stmt> Parser::for_statement() {
         condition = std::make_shared<Literal>(true);
     }
     // we create said while loop
-    body = std::make_shared<WhileStmt>(std::move(condition), std::move(body));
+    body = with_line(std::make_shared<WhileStmt>(std::move(condition), std::move(body)), line);
 
     // if we come across an initalizer, we run it once
     // and then pass in a final block statement
     if (initializer != nullptr) {
-        body = std::make_shared<Block>(
-            std::vector<std::shared_ptr<Stmt>>{std::move(initializer), std::move(body)});
+        body = with_line(std::make_shared<Block>(std::vector<std::shared_ptr<Stmt>>{
+                             std::move(initializer), std::move(body)}),
+                         line);
     }
 
     return body;
@@ -404,7 +423,7 @@ shared_ptr<Expr> Parser::assignment() {
         try {
             return expr->make_assignment(value);
         } catch (InvalidAssignment) {
-            LoxError::error(equals, "Invalid assignment target.");
+            errors.error(equals, "Invalid assignment target.");
         }
     }
     // We return the expression
@@ -654,7 +673,7 @@ Token Parser::peek() { return tokens.at(current); }
 Token Parser::previous() { return tokens.at(current - 1); }
 
 Parser::ParseError Parser::error(Token token, std::string message) {
-    LoxError::error(token, message);
+    errors.error(token, message);
     return ParseError{""};
 }
 
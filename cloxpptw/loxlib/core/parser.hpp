@@ -16,13 +16,15 @@ namespace CppLox {
 class Parser {
     std::vector<Token> tokens;
     int current = 0;
+    // Where we report syntax errors
+    LoxError &errors;
     struct ParseError : public std::runtime_error {
         // We inherit all the constructors from std::runtime_error
         using std::runtime_error::runtime_error;
     };
 
   public:
-    Parser(std::vector<Token> tokens);
+    Parser(std::vector<Token> tokens, LoxError &errors);
     std::vector<std ::shared_ptr<Stmt>> parse();
 
   private:
@@ -30,6 +32,7 @@ class Parser {
     std::shared_ptr<Stmt> class_declaration();
     std::shared_ptr<Stmt> var_declaration();
     std::shared_ptr<Stmt> statement();
+    std::shared_ptr<Stmt> with_line(std::shared_ptr<Stmt> stmt, int line);
     std::shared_ptr<Stmt> if_statement();
     std::shared_ptr<Stmt> while_statement();
     std::shared_ptr<Stmt> for_statement();
@@ -0,0 +1,49 @@
+#include "core/program.hpp"
+
+#include "core/parser.hpp"
+#include "core/scanner.hpp"
+#include "program.hpp"
+#include "runtime/purity.hpp"
+#include "runtime/resolver.hpp"
+#include "utils/error.hpp"
+
+using namespace CppLox;
+
+// Main logic for the front end, scanning, parsing and the static passes
+Program CppLox::compile(std::string source, DiagnosticSink &sink) {
+    Program program;
+    std::shared_ptr<Resolution> resolution = std::make_shared<Resolution>();
+    program.resolution = resolution;
+    // Error state for this compilation alone
+    LoxError errors(sink);
+
+    // We scan and parse the source code
+    Scanner scanner = Scanner(std::move(source), errors);
+    Parser parser = Parser(scanner.scan_tokens(), errors);
+    program.stmts = parser.parse();
+
+    // Catch scanner and parser errors
+    if (errors.had_error) {
+        program.had_error = true;
+        return program;
+    }
+
+    // If there are no syntax errors we can run our resolver
+    Resolver resolver = Resolver(resolution->locals, resolution->class_fields,
+                                 resolution->property_sites, errors);
+    resolver.resolve(program.stmts);
+    resolution->slot_cache =
+        std::make_unique<std::atomic<std::uint64_t>[]>(resolution->property_sites);
+
+    // We catch any resolution errors
+    if (errors.had_error) {
+        program.had_error = true;
+        return program;
+    }
+
+    // We look for pure functions up front, the interpreter decides whether to
+    // cache them
+    PurityAnalyzer analyzer = PurityAnalyzer(resolution->pure_functions);
+    analyzer.analyze(program.stmts);
+    return program;
+}
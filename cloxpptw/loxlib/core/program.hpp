@@ -0,0 +1,59 @@
+#ifndef PROGRAM_HPP
+#define PROGRAM_HPP
+
+#include "ast/expr.hpp"
+#include "ast/stmt.hpp"
+#include "utils/error.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace CppLox {
+
+// Everything the static passes learn about a program
+struct Resolution : std::enable_shared_from_this<Resolution> {
+    // Scope distance of every local variable expression, globals are left out
+    std::map<std::shared_ptr<Expr>, int> locals;
+    // Function declarations the purity analysis marked as safe to memoize
+    std::set<std::shared_ptr<Function>> pure_functions;
+    // Fields each class assigns through this in its init method, in the order
+    // they are first assigned
+    std::map<std::shared_ptr<Class>, std::vector<std::string>> class_fields;
+    // Number of Get and Set nodes, each was given a site index below this
+    std::size_t property_sites = 0;
+
+    // The field slot each property access found for the last class it met. This
+    // is the one thing that changes while the program runs, so every entry packs
+    // the class id above the slot + 1 in a single atomic word and interpreters on
+    // other threads always read a matching pair. 0 means nothing is cached yet
+    static constexpr unsigned SLOT_BITS = 16;
+    static constexpr std::uint64_t SLOT_MASK = (std::uint64_t{1} << SLOT_BITS) - 1;
+    std::unique_ptr<std::atomic<std::uint64_t>[]> slot_cache;
+};
+
+/*
+ * A scanned, parsed and resolved Lox program. Apart from the atomic slot cache
+ * nothing in here is modified once compile() returns, so a Program can be
+ * executed any number of times and shared between threads that each own their
+ * own Interpreter.
+ */
+struct Program {
+    std::vector<std::shared_ptr<Stmt>> stmts;
+    // Shared with every function the program declares, so closures stay valid
+    // after the Program itself is gone
+    std::shared_ptr<const Resolution> resolution;
+    // Set when scanning, parsing or resolving reported an error
+    bool had_error = false;
+};
+
+// Function to run the front end over some source code, errors go to the sink
+Program compile(std::string source, DiagnosticSink &sink = stderr_sink());
+
+} // namespace CppLox
+
+#endif
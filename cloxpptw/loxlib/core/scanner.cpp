@@ -6,21 +6,22 @@ using namespace CppLox;
 using std::string;
 using std::vector;
 
+// Reserved keywords, built once and shared by every scanner on every thread
+static const std::map<string, TokenType> keywords{
+    {"and", TokenType::AND},     {"class", TokenType::CLASS},   {"else", TokenType::ELSE},
+    {"false", TokenType::FALSE}, {"for", TokenType::FOR},       {"fun", TokenType::FUN},
+    {"if", TokenType::IF},       {"nil", TokenType::NIL},       {"or", TokenType::OR},
+    {"print", TokenType::PRINT}, {"return", TokenType::RETURN}, {"super", TokenType::SUPER},
+    {"this", TokenType::THIS},   {"true", TokenType::TRUE},     {"var", TokenType::VAR},
+    {"while", TokenType::WHILE},
+};
+
 /*
  * Constructor for our Scanner class
  * We pass in the source code as string
  */
-Scanner::Scanner(string source)
-    // We initialize our reserved keywords map
-    : keywords{
-          {"and", TokenType::AND},     {"class", TokenType::CLASS},   {"else", TokenType::ELSE},
-          {"false", TokenType::FALSE}, {"for", TokenType::FOR},       {"fun", TokenType::FUN},
-          {"if", TokenType::IF},       {"nil", TokenType::NIL},       {"or", TokenType::OR},
-          {"print", TokenType::PRINT}, {"return", TokenType::RETURN}, {"super", TokenType::SUPER},
-          {"this", TokenType::THIS},   {"true", TokenType::TRUE},     {"var", TokenType::VAR},
-          {"while", TokenType::WHILE},
-      } {
-    this->source = source;
+Scanner::Scanner(string source, LoxError &errors) : errors(errors) {
+    this->source = std::move(source);
 }
 
 // Function to scan tokens and return them as a vector
@@ -127,7 +128,7 @@ void Scanner::scan() {
         } else if (is_alpha(c)) {
             add_identifier();
         } else {
-            LoxError::error(line, "Unexpected character.");
+            errors.error(line, "Unexpected character.");
         }
         break;
     }
@@ -200,7 +201,7 @@ void Scanner::add_string() {
     }
     // If we reach the end of file with no terminating "
     if (is_end()) {
-        LoxError::error(line, "Unterminated string.");
+        errors.error(line, "Unterminated string.");
         return;
     }
 
@@ -245,7 +246,7 @@ void Scanner::multiline_comment() {
         }
     }
     // We throw an error if we don't close comments
-    LoxError::error(mlc_line, "Multiline comment unterminated.");
+    errors.error(mlc_line, "Multiline comment unterminated.");
 }
 
 // Function to handle adding number tokens
@@ -21,12 +21,12 @@ class Scanner {
     int current = 0;
     // Line number
     int line = 1;
+    // Where we report lexical errors
+    LoxError &errors;
 
   public:
     // Constructor for parsing code
-    Scanner(std::string source);
-    // Default constructor
-    Scanner() : source("") {}
+    Scanner(std::string source, LoxError &errors);
 
     std::vector<Token> scan_tokens();
 
@@ -47,9 +47,6 @@ class Scanner {
     bool is_digit(char c);
     bool is_alpha_num(char c);
     bool is_alpha(char c);
-
-    // Reserved keywords
-    const std::map<std::string, TokenType> keywords;
 };
 
 } // namespace CppLox
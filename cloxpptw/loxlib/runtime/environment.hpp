@@ -1,18 +1,19 @@
 #ifndef ENVIRONMENT_HPP
 #define ENVIRONMENT_HPP
 
+#include "runtime/pool.hpp"
 #include "utils/error.hpp"
+#include "utils/ref.hpp"
 #include "utils/tokens.hpp"
 
 #include <any>
 #include <map>
-#include <memory>
 #include <string>
 #include <utility>
 
 namespace CppLox {
 
-class Environment : public std::enable_shared_from_this<Environment> {
+class Environment : public RefCounted {
     // Ordered map of keys and values
     std::map<std::string, std::any> values;
 
@@ -21,11 +22,20 @@ class Environment : public std::enable_shared_from_this<Environment> {
      * We pass in an Environment pointer and move ownership
      * By default enclosing is a nullptr
      */
-    Environment(std::shared_ptr<Environment> enclosing = nullptr)
+    Environment(Ref<Environment> enclosing = nullptr)
         : enclosing(std::move(enclosing)) {}
 
-    // shared_ptr to the Environment
-    std::shared_ptr<Environment> enclosing;
+    // Handle to the enclosing Environment
+    Ref<Environment> enclosing;
+
+    // Every block and call creates an environment, so we recycle their memory
+    // through a free list owned by the running thread
+    static FreeList &pool() {
+        thread_local FreeList pool(sizeof(Environment), 4096);
+        return pool;
+    }
+    static void *operator new(std::size_t) { return pool().allocate(); }
+    static void operator delete(void *block) { pool().release(block); }
 
     // Function to define and store variables in the map
     void define(std::string name, std::any value) {
@@ -89,12 +99,12 @@ class Environment : public std::enable_shared_from_this<Environment> {
     }
 
     // Function to walk the environment chain and return the appropriate environment
-    std::shared_ptr<Environment> ancestor(int distance) {
-        // We create a new environment shared from the parent
-        std::shared_ptr<Environment> environment = shared_from_this();
+    Environment *ancestor(int distance) {
+        // We walk raw pointers, the chain is kept alive by our caller
+        Environment *environment = this;
         // We create an iterator to walk the distance and return the enclosing environment
         for (int i = 0; i < distance; ++i) {
-            environment = environment->enclosing;
+            environment = environment->enclosing.get();
         }
         // We can then return the environment
         return environment;
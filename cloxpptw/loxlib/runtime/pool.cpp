@@ -0,0 +1,44 @@
+#include "runtime/pool.hpp"
+
+#include "pool.hpp"
+
+#include <algorithm>
+#include <new>
+#include <utility>
+
+using namespace CppLox;
+
+// Every block has to be able to hold the free list link
+FreeList::FreeList(std::size_t block_size, std::size_t max_cached)
+    : block_size(std::max(block_size, sizeof(Node))), max_cached(max_cached) {}
+
+FreeList::~FreeList() {
+    while (head != nullptr) {
+        ::operator delete(std::exchange(head, head->next));
+    }
+}
+
+void *FreeList::allocate() {
+    ++counts.allocations;
+    if (head == nullptr) {
+        return ::operator new(block_size);
+    }
+    ++counts.reused;
+    --cached;
+    return std::exchange(head, head->next);
+}
+
+void FreeList::release(void *block) {
+    if (cached == max_cached) {
+        ::operator delete(block);
+        return;
+    }
+    head = new (block) Node{head};
+    ++cached;
+}
+
+void CppLox::write_pool_stats(std::ostream &out, const char *name, const PoolStats &stats) {
+    out << name << " pool: " << stats.reused << " of " << stats.allocations
+        << " allocations reused (" << static_cast<int>(stats.hit_rate() * 100.0 + 0.5)
+        << "% hit rate)\n";
+}
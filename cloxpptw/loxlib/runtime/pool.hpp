@@ -0,0 +1,56 @@
+#ifndef POOL_HPP
+#define POOL_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+namespace CppLox {
+
+// Counters for a pool, reused is how many allocations came from the free list
+struct PoolStats {
+    std::uint64_t allocations = 0;
+    std::uint64_t reused = 0;
+
+    double hit_rate() const {
+        return allocations == 0 ? 0.0 : static_cast<double>(reused) / static_cast<double>(allocations);
+    }
+    PoolStats operator-(const PoolStats &before) const {
+        return {allocations - before.allocations, reused - before.reused};
+    }
+};
+
+/*
+ * Free list of equally sized blocks. Released blocks are kept for the next
+ * allocation instead of going back to malloc, up to a cap so a deep recursion
+ * does not pin its peak memory forever. A pool is not thread safe, every thread
+ * uses its own.
+ */
+class FreeList {
+    struct Node {
+        Node *next;
+    };
+
+    Node *head = nullptr;
+    std::size_t cached = 0;
+    std::size_t block_size;
+    std::size_t max_cached;
+    PoolStats counts;
+
+  public:
+    FreeList(std::size_t block_size, std::size_t max_cached);
+    ~FreeList();
+    FreeList(const FreeList &) = delete;
+    FreeList &operator=(const FreeList &) = delete;
+
+    void *allocate();
+    void release(void *block);
+    const PoolStats &stats() const { return counts; }
+};
+
+// Function to print pool counters in the same format for every pool
+void write_pool_stats(std::ostream &out, const char *name, const PoolStats &stats);
+
+} // namespace CppLox
+
+#endif
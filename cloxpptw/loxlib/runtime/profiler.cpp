@@ -0,0 +1,105 @@
+#include "runtime/profiler.hpp"
+
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <iomanip>
+
+using namespace CppLox;
+
+// Converts a duration to fractional milliseconds for the report
+static double to_ms(std::chrono::steady_clock::duration duration) {
+    return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+Profiler::Profiler() { enter(this, "<script>"); }
+
+// Function to push a new call onto the profiler stack
+void Profiler::enter(const void *key, std::string_view name, std::string_view owner) {
+    FunctionStats &stats = functions[key];
+    // We only build the display name the first time we see a function
+    if (stats.name.empty()) {
+        if (!owner.empty()) {
+            stats.name.append(owner).append(".");
+        }
+        stats.name.append(name);
+    }
+    ++stats.calls;
+    ++stats.active;
+
+    // We extend the folded path with the new frame
+    std::size_t path_length = path.size();
+    if (!path.empty()) {
+        path += ';';
+    }
+    path += stats.name;
+
+    stack.push_back(Frame{&stats, Clock::now(), Clock::duration{0}, path_length});
+}
+
+// Function to pop the innermost call and account for its time
+void Profiler::exit() {
+    Clock::duration elapsed = Clock::now() - stack.back().start;
+    Frame &frame = stack.back();
+    Clock::duration self = elapsed - frame.children;
+
+    FunctionStats &stats = *frame.stats;
+    stats.self += self;
+    // Recursive calls are already covered by the outermost frame
+    if (--stats.active == 0) {
+        stats.inclusive += elapsed;
+    }
+    folded[path] += self;
+
+    // We restore the path and charge our time to the caller
+    path.resize(frame.path_length);
+    stack.pop_back();
+    if (!stack.empty()) {
+        stack.back().children += elapsed;
+    }
+}
+
+// Function to close the root frame, any frames left open are closed as well
+void Profiler::finish() {
+    while (!stack.empty()) {
+        exit();
+    }
+}
+
+// Function to write a human readable summary of the run
+void Profiler::write_report(std::ostream &out) {
+    finish();
+
+    // We sort functions by self time so the hot spots come first
+    std::vector<const FunctionStats *> rows;
+    for (const auto &entry : functions) {
+        rows.push_back(&entry.second);
+    }
+    std::sort(rows.begin(), rows.end(),
+              [](const FunctionStats *a, const FunctionStats *b) { return a->self > b->self; });
+
+    out << std::left << std::setw(24) << "function" << std::right << std::setw(12) << "calls"
+        << std::setw(14) << "self ms" << std::setw(14) << "incl ms" << "\n";
+    for (const FunctionStats *stats : rows) {
+        out << std::left << std::setw(24) << stats->name << std::right << std::setw(12)
+            << stats->calls << std::setw(14) << std::fixed << std::setprecision(3)
+            << to_ms(stats->self) << std::setw(14) << to_ms(stats->inclusive) << "\n";
+    }
+
+    out << "\n" << std::left << std::setw(24) << "line" << std::right << std::setw(12) << "hits"
+        << "\n";
+    for (const auto &[line, hits] : line_hits) {
+        out << std::left << std::setw(24) << line << std::right << std::setw(12) << hits << "\n";
+    }
+}
+
+// Function to write the folded stacks, one "a;b;c <microseconds>" line per stack
+void Profiler::write_folded(std::ostream &out) {
+    finish();
+    for (const auto &[stack_path, self] : folded) {
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(self).count();
+        if (us > 0) {
+            out << stack_path << " " << us << "\n";
+        }
+    }
+}
@@ -0,0 +1,93 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace CppLox {
+
+/*
+ * Call profiler for the tree walker. The interpreter only creates one when
+ * --profile is passed, every hook is guarded by a null check so a normal run
+ * does not pay for any of this.
+ */
+class Profiler {
+    using Clock = std::chrono::steady_clock;
+
+    // Totals we collect for each function
+    struct FunctionStats {
+        // Name shown in the report and the folded stacks, methods are qualified
+        // with their class
+        std::string name;
+        std::uint64_t calls = 0;
+        Clock::duration self{0};
+        Clock::duration inclusive{0};
+        // How many frames of this function are on the stack, recursion should
+        // only count towards the inclusive time once
+        int active = 0;
+    };
+
+    // A single active call on the profiler stack
+    struct Frame {
+        FunctionStats *stats;
+        Clock::time_point start;
+        // Time spent in calls made from this frame
+        Clock::duration children{0};
+        // Length of the folded path before this frame was pushed
+        std::size_t path_length;
+    };
+
+    std::vector<Frame> stack;
+    // The current stack joined with ';' in the folded stack format
+    std::string path;
+    // Keyed by the declaration rather than the name, so functions that share a
+    // name are counted apart
+    std::map<const void *, FunctionStats> functions;
+    std::map<int, std::uint64_t> line_hits;
+    // Self time for every unique call stack
+    std::map<std::string, Clock::duration> folded;
+
+  public:
+    // We open a root frame for the top level script
+    Profiler();
+
+    // Function to open a call of the function identified by key, owner is the
+    // class of a method and empty otherwise
+    void enter(const void *key, std::string_view name, std::string_view owner = {});
+    void exit();
+    void hit_line(int line) { ++line_hits[line]; }
+
+    // Functions to dump the results once the script is done
+    void write_report(std::ostream &out);
+    void write_folded(std::ostream &out);
+
+    // RAII helper so calls are closed even when we unwind through a Return or an error
+    struct Scope {
+        Scope(Profiler *profiler, const void *key, std::string_view name,
+              std::string_view owner = {})
+            : profiler(profiler) {
+            if (profiler != nullptr) {
+                profiler->enter(key, name, owner);
+            }
+        }
+        ~Scope() {
+            if (profiler != nullptr) {
+                profiler->exit();
+            }
+        }
+        Profiler *profiler;
+    };
+
+  private:
+    // Helper to close the root frame before reporting
+    void finish();
+};
+
+} // namespace CppLox
+
+#endif
@@ -0,0 +1,277 @@
+#include "runtime/purity.hpp"
+
+#include "purity.hpp"
+
+using namespace CppLox;
+using std::any;
+using std::shared_ptr;
+using std::string;
+using std::vector;
+
+PurityAnalyzer::PurityAnalyzer(std::set<shared_ptr<Function>> &pure_functions)
+    : pure_functions(pure_functions) {}
+
+// Main logic to find pure functions in a program
+void PurityAnalyzer::analyze(const vector<shared_ptr<Stmt>> &stmts) {
+    // We count how many times each name is declared at the top level, a function
+    // that gets redeclared or shadowed by a global can change under our feet
+    std::map<string, int> declarations;
+    for (const shared_ptr<Stmt> &stmt : stmts) {
+        if (auto function = std::dynamic_pointer_cast<Function>(stmt)) {
+            declarations[function->name.lexeme]++;
+            candidates[function->name.lexeme] = function;
+        } else if (auto var = std::dynamic_pointer_cast<Var>(stmt)) {
+            declarations[var->name.lexeme]++;
+        } else if (auto klass = std::dynamic_pointer_cast<Class>(stmt)) {
+            declarations[klass->name.lexeme]++;
+        }
+    }
+
+    // We walk the whole program once to find every assignment target
+    collecting = true;
+    check(stmts);
+    collecting = false;
+
+    // Functions whose global binding can be replaced are out
+    for (auto it = candidates.begin(); it != candidates.end();) {
+        if (declarations[it->first] > 1 || assigned.contains(it->first)) {
+            it = candidates.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    // Purity depends on the purity of the callees, so we keep dropping impure
+    // functions until the candidate set stops changing
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (auto it = candidates.begin(); it != candidates.end();) {
+            if (!is_pure(it->second)) {
+                it = candidates.erase(it);
+                changed = true;
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    // Whatever survived is pure
+    for (const auto &[name, function] : candidates) {
+        pure_functions.insert(function);
+    }
+}
+
+// Function to check a single function body
+bool PurityAnalyzer::is_pure(const shared_ptr<Function> &function) {
+    impure = false;
+    // The parameters make up the outermost local scope
+    scopes.clear();
+    scopes.emplace_back();
+    for (const Token &param : function->params) {
+        scopes.back().insert(param.lexeme);
+    }
+    check(function->body);
+    scopes.clear();
+    return !impure;
+}
+
+// Block statements introduce a new local scope
+any PurityAnalyzer::visitBlockStmt(shared_ptr<Block> stmt) {
+    scopes.emplace_back();
+    check(stmt->stmts);
+    scopes.pop_back();
+    return {};
+}
+
+// Variable declarations are local to the function so they are fine
+any PurityAnalyzer::visitVarStmt(shared_ptr<Var> stmt) {
+    if (stmt->initializer != nullptr) {
+        check(stmt->initializer);
+    }
+    if (!scopes.empty()) {
+        scopes.back().insert(stmt->name.lexeme);
+    }
+    return {};
+}
+
+any PurityAnalyzer::visitIfStmt(shared_ptr<IfStmt> stmt) {
+    check(stmt->condition);
+    check(stmt->then_branch);
+    if (stmt->else_branch != nullptr) {
+        check(stmt->else_branch);
+    }
+    return {};
+}
+
+any PurityAnalyzer::visitExpressionStmt(shared_ptr<ExpressionStmt> stmt) {
+    check(stmt->expr);
+    return {};
+}
+
+// Nested functions capture the current scope so we treat them as impure
+any PurityAnalyzer::visitFunctionStmt(shared_ptr<Function> stmt) {
+    if (!collecting) {
+        impure = true;
+        return {};
+    }
+    // While collecting we still need to look inside for assignments
+    scopes.emplace_back();
+    for (const Token &param : stmt->params) {
+        scopes.back().insert(param.lexeme);
+    }
+    check(stmt->body);
+    scopes.pop_back();
+    return {};
+}
+
+// Printing is a side effect
+any PurityAnalyzer::visitPrintStmt(shared_ptr<Print> stmt) {
+    impure = true;
+    check(stmt->expr);
+    return {};
+}
+
+any PurityAnalyzer::visitReturnStmt(shared_ptr<ReturnStmt> stmt) {
+    if (stmt->expr != nullptr) {
+        check(stmt->expr);
+    }
+    return {};
+}
+
+any PurityAnalyzer::visitWhileStmt(shared_ptr<WhileStmt> while_stmt) {
+    check(while_stmt->condition);
+    check(while_stmt->body);
+    return {};
+}
+
+// Classes are only walked to collect assignments inside their methods
+any PurityAnalyzer::visitClassStmt(shared_ptr<Class> stmt) {
+    if (!collecting) {
+        impure = true;
+        return {};
+    }
+    for (const shared_ptr<Function> &method : stmt->methods) {
+        visitFunctionStmt(method);
+    }
+    return {};
+}
+
+// Prefix operators write to a variable, which has to be one of our locals
+any PurityAnalyzer::visitPreFixOpExpr(shared_ptr<PreFixOp> expr) {
+    assigned.insert(expr->name.lexeme);
+    if (!is_local(expr->name.lexeme)) {
+        impure = true;
+    }
+    check(expr->target);
+    return {};
+}
+
+any PurityAnalyzer::visitConditonalExpr(shared_ptr<Condtional> expr) {
+    check(expr->condition);
+    check(expr->truth_expr);
+    check(expr->false_expr);
+    return {};
+}
+
+// Anything touching instances depends on mutable state
+any PurityAnalyzer::visitSuperExpr(shared_ptr<Super>) {
+    impure = true;
+    return {};
+}
+
+any PurityAnalyzer::visitThisExpr(shared_ptr<This>) {
+    impure = true;
+    return {};
+}
+
+any PurityAnalyzer::visitSetExpr(shared_ptr<Set> expr) {
+    impure = true;
+    check(expr->object);
+    check(expr->value);
+    return {};
+}
+
+any PurityAnalyzer::visitGetExpr(shared_ptr<Get> expr) {
+    impure = true;
+    check(expr->object);
+    return {};
+}
+
+// Calls are only allowed to other pure top level functions
+any PurityAnalyzer::visitCallExpr(shared_ptr<Call> expr) {
+    auto callee = std::dynamic_pointer_cast<Variable>(expr->callee);
+    if (callee == nullptr || is_local(callee->name.lexeme) ||
+        !candidates.contains(callee->name.lexeme)) {
+        impure = true;
+    }
+    check(expr->callee);
+    for (const shared_ptr<Expr> &arg : expr->args) {
+        check(arg);
+    }
+    return {};
+}
+
+any PurityAnalyzer::visitLogicalExpr(shared_ptr<Logical> expr) {
+    check(expr->left);
+    check(expr->right);
+    return {};
+}
+
+// Assignments have to target one of the function's own locals
+any PurityAnalyzer::visitAssignExpr(shared_ptr<Assign> expr) {
+    assigned.insert(expr->name.lexeme);
+    if (!is_local(expr->name.lexeme)) {
+        impure = true;
+    }
+    check(expr->value);
+    return {};
+}
+
+any PurityAnalyzer::visitBinaryExpr(shared_ptr<Binary> expr) {
+    check(expr->left);
+    check(expr->right);
+    return {};
+}
+
+any PurityAnalyzer::visitUnaryExpr(shared_ptr<Unary> expr) {
+    check(expr->right);
+    return {};
+}
+
+any PurityAnalyzer::visitGroupingExpr(shared_ptr<Grouping> expr) {
+    check(expr->expr);
+    return {};
+}
+
+any PurityAnalyzer::visitLiteralExpr(shared_ptr<Literal>) { return {}; }
+
+// Reading a global is only safe if it names a pure function, any other global
+// could change between two calls with the same arguments
+any PurityAnalyzer::visitVariableExpr(shared_ptr<Variable> expr) {
+    if (!is_local(expr->name.lexeme) && !candidates.contains(expr->name.lexeme)) {
+        impure = true;
+    }
+    return {};
+}
+
+// Helper to walk a list of statements
+void PurityAnalyzer::check(const vector<shared_ptr<Stmt>> &stmts) {
+    for (const shared_ptr<Stmt> &stmt : stmts) {
+        check(stmt);
+    }
+}
+
+void PurityAnalyzer::check(shared_ptr<Stmt> stmt) { stmt->accept(*this); }
+
+void PurityAnalyzer::check(shared_ptr<Expr> expr) { expr->accept(*this); }
+
+// We search the scopes from the innermost outwards
+bool PurityAnalyzer::is_local(const string &name) {
+    for (auto it = scopes.rbegin(); it != scopes.rend(); ++it) {
+        if (it->contains(name)) {
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,79 @@
+#ifndef PURITY_HPP
+#define PURITY_HPP
+
+#include "ast/expr.hpp"
+#include "ast/stmt.hpp"
+#include "core/program.hpp"
+
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace CppLox {
+
+/*
+ * Static pass that finds top level functions whose result only depends on their
+ * arguments. A function is pure when it does not print, does not touch fields,
+ * this or super, only reads and writes its own locals and only calls other pure
+ * functions. The interpreter can then safely cache calls to them.
+ */
+class PurityAnalyzer : ExprVisitor, StmtVisitor {
+    // Where we hand over the functions that turn out to be pure
+    std::set<std::shared_ptr<Function>> &pure_functions;
+    // Top level functions that are still considered pure, keyed by name
+    std::map<std::string, std::shared_ptr<Function>> candidates;
+    // Every name that is assigned to anywhere in the program
+    std::set<std::string> assigned;
+    // Names declared locally inside the function we are checking
+    std::vector<std::set<std::string>> scopes;
+    // True while we are only collecting assignments over the whole program
+    bool collecting = false;
+    // Set as soon as we find something impure in the current function
+    bool impure = false;
+
+  public:
+    PurityAnalyzer(std::set<std::shared_ptr<Function>> &pure_functions);
+    // Function to analyze a program and mark its pure functions
+    void analyze(const std::vector<std::shared_ptr<Stmt>> &stmts);
+
+  private:
+    std::any visitBlockStmt(std::shared_ptr<Block> stmt) override;
+    std::any visitVarStmt(std::shared_ptr<Var> stmt) override;
+    std::any visitIfStmt(std::shared_ptr<IfStmt> stmt) override;
+    std::any visitExpressionStmt(std::shared_ptr<ExpressionStmt> stmt) override;
+    std::any visitFunctionStmt(std::shared_ptr<Function> stmt) override;
+    std::any visitPrintStmt(std::shared_ptr<Print> stmt) override;
+    std::any visitReturnStmt(std::shared_ptr<ReturnStmt> stmt) override;
+    std::any visitWhileStmt(std::shared_ptr<WhileStmt> while_stmt) override;
+    std::any visitClassStmt(std::shared_ptr<Class> stmt) override;
+
+    std::any visitPreFixOpExpr(std::shared_ptr<PreFixOp> expr) override;
+    std::any visitConditonalExpr(std::shared_ptr<Condtional> expr) override;
+    std::any visitSuperExpr(std::shared_ptr<Super> expr) override;
+    std::any visitThisExpr(std::shared_ptr<This> expr) override;
+    std::any visitSetExpr(std::shared_ptr<Set> expr) override;
+    std::any visitGetExpr(std::shared_ptr<Get> expr) override;
+    std::any visitCallExpr(std::shared_ptr<Call> expr) override;
+    std::any visitLogicalExpr(std::shared_ptr<Logical> expr) override;
+    std::any visitAssignExpr(std::shared_ptr<Assign> expr) override;
+    std::any visitBinaryExpr(std::shared_ptr<Binary> expr) override;
+    std::any visitUnaryExpr(std::shared_ptr<Unary> expr) override;
+    std::any visitGroupingExpr(std::shared_ptr<Grouping> expr) override;
+    std::any visitLiteralExpr(std::shared_ptr<Literal> expr) override;
+    std::any visitVariableExpr(std::shared_ptr<Variable> expr) override;
+
+    // Helpers to walk statements and expressions
+    void check(const std::vector<std::shared_ptr<Stmt>> &stmts);
+    void check(std::shared_ptr<Stmt> stmt);
+    void check(std::shared_ptr<Expr> expr);
+    // Function to test a single candidate against the current candidate set
+    bool is_pure(const std::shared_ptr<Function> &function);
+    // Helper to test if a name was declared inside the function being checked
+    bool is_local(const std::string &name);
+};
+
+} // namespace CppLox
+
+#endif
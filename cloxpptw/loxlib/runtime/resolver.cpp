@@ -2,12 +2,18 @@
 
 #include "resolver.hpp"
 
+#include <algorithm>
+
 using namespace CppLox;
 using std::any;
 using std::shared_ptr;
 using std::vector;
 
-Resolver::Resolver(Interpreter &interpreter) : interpreter(interpreter) {}
+Resolver::Resolver(std::map<shared_ptr<Expr>, int> &locals,
+                   std::map<shared_ptr<Class>, vector<std::string>> &class_fields,
+                   std::size_t &property_sites, LoxError &errors)
+    : locals(locals), class_fields(class_fields), property_sites(property_sites),
+      errors(errors) {}
 
 // Overload to resolve vectors of statements
 void Resolver::resolve(const vector<shared_ptr<Stmt>> &stmts) {
@@ -82,14 +88,14 @@ any Resolver::visitPrintStmt(shared_ptr<Print> stmt) {
 any Resolver::visitReturnStmt(shared_ptr<ReturnStmt> stmt) {
     // We need to ensure that the user is not using return outside of a block
     if (current_function == FunctionType::NONE) {
-        LoxError::error(stmt->keyword, "Can't return from top-level code.");
+        errors.error(stmt->keyword, "Can't return from top-level code.");
     }
 
     // We test if there is a returned expression and resolve it
     if (stmt->expr != nullptr) {
         resolve(stmt->expr);
         if (current_function == FunctionType::INIT) {
-            LoxError::error(stmt->keyword, "Can't return a value from an initializer.");
+            errors.error(stmt->keyword, "Can't return a value from an initializer.");
         }
     }
     return {};
@@ -108,6 +114,8 @@ any Resolver::visitClassStmt(shared_ptr<Class> stmt) {
     // We set the enclosing class and current class
     ClassType enclosing_class = current_class;
     current_class = ClassType::CLASS;
+    // A class declared inside an init method has its own fields
+    vector<std::string> *enclosing_fields = init_fields;
 
     declare(stmt->name);
     define(stmt->name);
@@ -117,7 +125,7 @@ any Resolver::visitClassStmt(shared_ptr<Class> stmt) {
         // We first check to see if the superclass name matches the class name
         if (stmt->name.lexeme == stmt->superclass->name.lexeme) {
             // If it does we throw an error
-            LoxError::error(stmt->superclass->name, "A class can't inherit from itself.");
+            errors.error(stmt->superclass->name, "A class can't inherit from itself.");
         }
         current_class = ClassType::SUBCLASS;
         // Otherwise we try to resolve
@@ -146,8 +154,11 @@ any Resolver::visitClassStmt(shared_ptr<Class> stmt) {
         if (method->name.lexeme == "init") {
             declaration = FunctionType::INIT;
         }
+        // We collect the fields the initializer sets so instances can be laid out up front
+        init_fields = declaration == FunctionType::INIT ? &class_fields[stmt] : nullptr;
         resolve_function(method, declaration);
     }
+    init_fields = enclosing_fields;
 
     // After resolving the class we end the scope
     end_scope();
@@ -181,11 +192,11 @@ any Resolver::visitSuperExpr(shared_ptr<Super> expr) {
     // We check to see if we are outside of a class body
     if (current_class == ClassType::NONE) {
         // We throw an error if so
-        LoxError::error(expr->keyword, "Can't use 'super' outside of a class.");
+        errors.error(expr->keyword, "Can't use 'super' outside of a class.");
         // We then check if we are not a sub class
     } else if (current_class != ClassType::SUBCLASS) {
         // We throw and error if so
-        LoxError::error(expr->keyword, "Can't use 'super' in a class with no superclass.");
+        errors.error(expr->keyword, "Can't use 'super' in a class with no superclass.");
     }
     // Otherwise we resolve the local variable
     resolve_local(expr, expr->keyword);
@@ -206,7 +217,7 @@ any Resolver::visitThisExpr(shared_ptr<This> expr) {
     // We test to see if we are inside of a class
     if (current_class == ClassType::NONE) {
         // If we are not we throw an error
-        LoxError::error(expr->keyword, "Can't use 'this' outside of a class.");
+        errors.error(expr->keyword, "Can't use 'this' outside of a class.");
         return {};
     }
     // Otherwise we resolve
@@ -216,13 +227,25 @@ any Resolver::visitThisExpr(shared_ptr<This> expr) {
 
 // Function to resolve Setter node
 any Resolver::visitSetExpr(shared_ptr<Set> expr) {
+    expr->site = property_sites++;
     resolve(expr->value);
     resolve(expr->object);
+
+    // Assignments to this directly inside init give the class its field layout,
+    // anything set elsewhere spills to the instance's side table at runtime
+    if (init_fields != nullptr && current_function == FunctionType::INIT &&
+        std::dynamic_pointer_cast<This>(expr->object) != nullptr) {
+        if (std::find(init_fields->begin(), init_fields->end(), expr->name.lexeme) ==
+            init_fields->end()) {
+            init_fields->push_back(expr->name.lexeme);
+        }
+    }
     return {};
 }
 
 // Function to resolve the Getter node
 any Resolver::visitGetExpr(shared_ptr<Get> expr) {
+    expr->site = property_sites++;
     resolve(expr->object);
     return {};
 }
@@ -285,7 +308,7 @@ any Resolver::visitVariableExpr(shared_ptr<Variable> expr) {
         // We test if the iterator is inside the scope and if the name is set to false
         if (it != scope.end() && it->second == false)
             // If so we throw an error
-            LoxError::error(expr->name, "Can't read local variable in its own initializer.");
+            errors.error(expr->name, "Can't read local variable in its own initializer.");
     }
     // Otherwise we resolve the local variable
     resolve_local(expr, expr->name);
@@ -313,8 +336,8 @@ void Resolver::resolve_local(const shared_ptr<Expr> &expr, Token name) {
      */
     for (auto it = scopes.rbegin(); it != scopes.rend(); ++it) {
         /*
-         * If we match the name, we ask the interpreter to resolve it and pass in
-         * the number corresponding the scope
+         * If we match the name, we record the expression with the number
+         * corresponding the scope
          * if its in the current scope we get 0
          * if its the enclosing scope we get 1
          * if its the scope outside of the immediate enclosing scope we get 2
@@ -323,7 +346,7 @@ void Resolver::resolve_local(const shared_ptr<Expr> &expr, Token name) {
         if (it->contains(name.lexeme)) {
             // We calculate the distance between the beginning of the reverse iterator
             // and the current increment
-            interpreter.resolve(expr, std::distance(scopes.rbegin(), it));
+            locals[expr] = static_cast<int>(std::distance(scopes.rbegin(), it));
             return;
         }
     }
@@ -364,7 +387,7 @@ void Resolver::declare(Token name) {
     auto it = scope.find(name.lexeme);
     if (it != scope.end()) {
         // If so we can kick an error
-        LoxError::error(name, "Already a variable with this name in this scope.");
+        errors.error(name, "Already a variable with this name in this scope.");
     }
 
     // we store the name with false
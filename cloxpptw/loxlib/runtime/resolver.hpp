@@ -3,7 +3,7 @@
 
 #include "ast/expr.hpp"
 #include "ast/stmt.hpp"
-#include "core/interpreter.hpp"
+#include "core/program.hpp"
 #include "utils/error.hpp"
 
 #include <map>
@@ -18,15 +18,25 @@ enum class FunctionType { NONE, FUNCTION, METHOD, INIT };
 enum class ClassType { NONE, CLASS, SUBCLASS };
 
 class Resolver : ExprVisitor, StmtVisitor {
-    // We need to store a reference to our interpreter to walk the nodes produced
-    Interpreter &interpreter;
+    // Where we record the scope distance of each local variable we resolve
+    std::map<std::shared_ptr<Expr>, int> &locals;
+    // Where we record the fields each class sets up in its init method
+    std::map<std::shared_ptr<Class>, std::vector<std::string>> &class_fields;
+    // Counter we number the Get and Set nodes with
+    std::size_t &property_sites;
+    // Where we report resolution errors
+    LoxError &errors;
     // We create a vector of map objects to store our scopes
     std::vector<std::map<std::string, bool>> scopes;
     FunctionType current_function = FunctionType::NONE;
     ClassType current_class = ClassType::NONE;
+    // Field list of the class whose init method we are resolving, if any
+    std::vector<std::string> *init_fields = nullptr;
 
   public:
-    Resolver(Interpreter &interpreter);
+    Resolver(std::map<std::shared_ptr<Expr>, int> &locals,
+             std::map<std::shared_ptr<Class>, std::vector<std::string>> &class_fields,
+             std::size_t &property_sites, LoxError &errors);
     // Function to resolve lists of statements
     void resolve(const std::vector<std::shared_ptr<Stmt>> &stmts);
     std::any visitBlockStmt(std::shared_ptr<Block> stmt) override;
@@ -5,6 +5,7 @@
 
 #include <iostream>
 #include <stdexcept>
+#include <string>
 
 namespace CppLox {
 
@@ -26,22 +27,55 @@ class InvalidAssignment : public std::runtime_error {
     InvalidAssignment(std::string message) : std::runtime_error{message.c_str()} {}
 };
 
+// Interface for wherever diagnostics end up, embedders can plug in their own
+class DiagnosticSink {
+  public:
+    virtual ~DiagnosticSink() = default;
+    // Called for scanner, parser and resolver errors
+    virtual void compile_error(int line, const std::string &where, const std::string &message) = 0;
+    // Called for errors raised while the program runs
+    virtual void runtime_error(const RuntimeError &error) = 0;
+};
+
+// Default sink that writes to a stream, each diagnostic goes out in a single
+// write so threads sharing a stream do not interleave within a line
+class StreamSink : public DiagnosticSink {
+    std::ostream &out;
+
+  public:
+    StreamSink(std::ostream &out) : out(out) {}
+
+    void compile_error(int line, const std::string &where, const std::string &message) override {
+        out << "[line " + std::to_string(line) + "] Error" + where + ": " + message + "\n";
+    }
+
+    void runtime_error(const RuntimeError &error) override {
+        out << std::string(error.what()) + "\n[line " + std::to_string(error.token.line) + "]\n";
+    }
+};
+
+// The sink everything reports to unless told otherwise
+inline DiagnosticSink &stderr_sink() {
+    static StreamSink sink(std::cerr);
+    return sink;
+}
+
+/*
+ * Error state for a single compilation or interpreter. Every scanner, parser,
+ * resolver and interpreter reports into its own LoxError so several of them
+ * can run on different threads at once.
+ */
 class LoxError {
-    friend class Interpreter;
-    friend class Parser;
-    friend class Scanner;
-    friend class Resolver;
-    friend struct Lox;
+    DiagnosticSink *sink;
 
   public:
-    // Default constructor so the compiler does not yell at me
-    LoxError() = default;
-    static bool had_error;
-    static bool had_RuntimeError;
-
-    // A function to report errors to stderr
-    static void report(int line, std::string where, std::string message) {
-        std::cerr << "[line " << line << "] Error" << where << ": " << message << "\n";
+    LoxError(DiagnosticSink &sink = stderr_sink()) : sink(&sink) {}
+    bool had_error = false;
+    bool had_RuntimeError = false;
+
+    // A function to hand errors to the sink
+    void report(int line, std::string where, std::string message) {
+        sink->compile_error(line, where, message);
         had_error = true;
     }
 
@@ -51,9 +85,9 @@ class LoxError {
      * the object we inherit the string from can get destroyed and we still have
      * access to the message We do the same for the tokens
      */
-    static void error(int line, std::string message) { report(line, "", message); }
+    void error(int line, std::string message) { report(line, "", message); }
     // Error overload
-    static void error(Token token, std::string message) {
+    void error(Token token, std::string message) {
         if (token.type == TokenType::eof) {
             report(token.line, " at end", message);
         } else {
@@ -62,16 +96,12 @@ class LoxError {
     }
 
     // Function to report runtime errors
-    static void runtime_error(const RuntimeError &error) {
-        std::cerr << error.what() << "\n[line " << error.token.line << "]\n";
+    void runtime_error(const RuntimeError &error) {
+        sink->runtime_error(error);
         had_RuntimeError = true;
     }
 };
 
 } // namespace CppLox
 
-// Define static member variables
-inline bool CppLox::LoxError::had_error = false;
-inline bool CppLox::LoxError::had_RuntimeError = false;
-
 #endif
\ No newline at end of file
@@ -0,0 +1,105 @@
+#ifndef NATIVE_STACK_HPP
+#define NATIVE_STACK_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <pthread.h>
+#include <stdexcept>
+#include <string>
+
+namespace CppLox {
+
+/*
+ * The tree walker recurses on the native stack for every Lox call, so how deep
+ * a script can go depends on whatever stack the OS handed us (usually 8MB on the
+ * main thread). To make the depth limit predictable we run the whole pipeline on
+ * a worker thread whose stack we size ourselves from the configured call depth.
+ */
+
+// Native stack we budget for a single Lox call, this is generous on purpose so
+// deeply nested expressions inside a frame still fit in Debug builds
+inline constexpr std::size_t STACK_BYTES_PER_CALL = 8 * 1024;
+// Extra room for the scanner, parser, resolver and everything outside of calls
+inline constexpr std::size_t STACK_SLACK_BYTES = 8 * 1024 * 1024;
+// Deepest call depth we accept, its stack is still something the OS will hand out
+inline constexpr std::size_t MAX_CALL_DEPTH = 100000;
+
+// Helper to compute how big of a stack a given call depth needs
+inline std::size_t stack_size_for_depth(std::size_t max_call_depth) {
+    if (max_call_depth > (SIZE_MAX - STACK_SLACK_BYTES) / STACK_BYTES_PER_CALL) {
+        throw std::overflow_error("Call depth " + std::to_string(max_call_depth) +
+                                  " needs more stack than we can address.");
+    }
+    return STACK_SLACK_BYTES + max_call_depth * STACK_BYTES_PER_CALL;
+}
+
+/*
+ * A thread with a stack of the requested size. It has to be joined before it
+ * goes away, join() rethrows anything the work threw on the joining thread.
+ */
+class NativeThread {
+    // We bundle the work and any escaped exception so the thread can hand it
+    // back, it lives on the heap so the thread object itself can move
+    struct Payload {
+        std::function<void()> work;
+        std::exception_ptr error;
+    };
+    std::unique_ptr<Payload> payload;
+    pthread_t thread{};
+
+  public:
+    NativeThread(std::size_t stack_bytes, std::function<void()> work)
+        : payload(std::make_unique<Payload>(Payload{std::move(work), nullptr})) {
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setstacksize(&attr, stack_bytes);
+
+        int status = pthread_create(
+            &thread, &attr,
+            [](void *arg) -> void * {
+                Payload *payload = static_cast<Payload *>(arg);
+                try {
+                    payload->work();
+                } catch (...) {
+                    payload->error = std::current_exception();
+                }
+                return nullptr;
+            },
+            payload.get());
+        pthread_attr_destroy(&attr);
+
+        // Running inline would leave the depth limit guarding a stack that is too
+        // small for it, so a refused stack is an error
+        if (status != 0) {
+            throw std::runtime_error("Could not start a thread with a " +
+                                     std::to_string(stack_bytes) +
+                                     " byte stack: " + std::strerror(status));
+        }
+    }
+
+    NativeThread(NativeThread &&) = default;
+    NativeThread &operator=(NativeThread &&) = default;
+
+    // Function to wait for the work to finish
+    void join() {
+        pthread_join(thread, nullptr);
+        if (payload->error) {
+            std::rethrow_exception(payload->error);
+        }
+    }
+};
+
+// Function to run a callable on a thread with a stack of the requested size, we
+// block until it finishes
+inline void run_on_native_stack(std::size_t stack_bytes, std::function<void()> work) {
+    NativeThread thread(stack_bytes, std::move(work));
+    thread.join();
+}
+
+} // namespace CppLox
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef REF_HPP
+#define REF_HPP
+
+#include <cstddef>
+#include <utility>
+
+#ifdef CLOXPP_ATOMIC_REFCOUNT
+#include <atomic>
+#endif
+
+namespace CppLox {
+
+/*
+ * Base class for runtime objects that are owned through Ref handles. The count
+ * lives inside the object, so a handle is a single pointer and copying one is a
+ * plain increment. An interpreter only ever touches its objects from one thread,
+ * so the count is not atomic unless we build with CLOXPP_ATOMIC_REFCOUNT.
+ */
+class RefCounted {
+  public:
+    RefCounted() = default;
+    // Copies are new objects, nothing refers to them yet
+    RefCounted(const RefCounted &) {}
+    RefCounted &operator=(const RefCounted &) { return *this; }
+
+  protected:
+    ~RefCounted() = default;
+
+  private:
+    template <typename T> friend class Ref;
+
+#ifdef CLOXPP_ATOMIC_REFCOUNT
+    mutable std::atomic<long> refs{0};
+#else
+    mutable long refs = 0;
+#endif
+};
+
+// Intrusive owning handle to a RefCounted object, used like a std::shared_ptr
+template <typename T> class Ref {
+    T *ptr = nullptr;
+
+  public:
+    Ref() = default;
+    Ref(std::nullptr_t) {}
+    // Taking a raw pointer is always safe since the count lives in the object
+    explicit Ref(T *ptr) : ptr(ptr) { retain(); }
+    Ref(const Ref &other) : ptr(other.ptr) { retain(); }
+    Ref(Ref &&other) noexcept : ptr(std::exchange(other.ptr, nullptr)) {}
+    ~Ref() { release(); }
+
+    Ref &operator=(Ref other) noexcept {
+        std::swap(ptr, other.ptr);
+        return *this;
+    }
+
+    T *get() const { return ptr; }
+    T *operator->() const { return ptr; }
+    T &operator*() const { return *ptr; }
+    explicit operator bool() const { return ptr != nullptr; }
+
+    friend bool operator==(const Ref &a, const Ref &b) { return a.ptr == b.ptr; }
+    friend bool operator==(const Ref &a, std::nullptr_t) { return a.ptr == nullptr; }
+
+  private:
+    void retain() {
+        if (ptr != nullptr) {
+            ++ptr->refs;
+        }
+    }
+    void release() {
+        if (ptr != nullptr && --ptr->refs == 0) {
+            delete ptr;
+        }
+    }
+};
+
+// Function to allocate a RefCounted object and hand out the first reference
+template <typename T, typename... Args> Ref<T> make_ref(Args &&...args) {
+    return Ref<T>(new T(std::forward<Args>(args)...));
+}
+
+} // namespace CppLox
+
+#endif
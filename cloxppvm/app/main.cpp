@@ -1,6 +1,8 @@
 #include "../loxlib/chunk/chunk.hpp"
 #include "../loxlib/compiler/compiler.hpp"
+#include "../loxlib/vm/batch.hpp"
 #include "../loxlib/vm/vm.hpp"
+#include "batch_scripts.hpp"
 
 #include <cxxopts.hpp>
 #include <filesystem>
@@ -47,10 +49,22 @@ void repl() {
     }
 }
 
-void run_file(const std::filesystem::path &path) {
+// Debug switches for a single script run
+struct RunOptions {
+    bool disassemble = false;
+    bool gc_stress = false;
+    bool gc_log = false;
+    std::size_t max_frames = VM::DEFAULT_MAX_FRAMES;
+};
+
+void run_file(const std::filesystem::path &path, const RunOptions &run_options) {
     std::string contents = slurp_file(path);
 
     VM vm = VM(contents);
+    vm.disassemble_ = run_options.disassemble;
+    vm.heap_.stress_ = run_options.gc_stress;
+    vm.heap_.log_ = run_options.gc_log;
+    vm.max_frames_ = run_options.max_frames;
     InterpretResult result = vm.interpret();
 
     if (result == InterpretResult::INTERPRET_COMPILE_ERROR) {
@@ -61,35 +75,71 @@ void run_file(const std::filesystem::path &path) {
     }
 }
 
+// Function to run every script of a batch and report each one in order
+int run_batch(const std::string &source, unsigned jobs) {
+    std::vector<std::string> scripts = cloxpp::collect_batch_scripts(source);
+    if (scripts.empty()) {
+        fmt::println(stderr, "Error: No scripts found in {}", source);
+        return 66;
+    }
+
+    // Every script gets a header with its status, followed by what it printed
+    std::size_t failed = 0;
+    BatchRunner runner = BatchRunner(jobs);
+    runner.run(scripts, [&](const BatchResult &result) {
+        fmt::print("=== {} (exit {})\n{}", result.path_, result.exit_status_, result.output_);
+        if (result.exit_status_ != 0) {
+            ++failed;
+        }
+    });
+    std::fflush(stdout);
+
+    fmt::println(stderr, "Ran {} scripts, {} failed", scripts.size(), failed);
+    return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
 int main(int argc, const char **argv) {
     cxxopts::Options options("cloxxvm", "Implementation of cloxx in C++");
 
     options.add_options()("h,help", "This message")("r,repl", "REPL entry point")(
-        "f,file", "Lox Script", cxxopts::value<std::string>());
-
-    std::filesystem::path file = argv[1];
-    std::string source = slurp_file(file);
-    Compiler compiler = Compiler(source);
-    compiler.compile();
-
-    // try {
-    //     // We can now parse our options
-    //     auto result{options.parse(argc, argv)};
-
-    //     if (result.count("help")) {
-    //         std::cout << options.help() << std::endl;
-    //     } else if (result.count("file")) {
-    //         // run_file(result["file"].as<std::string>());
-    //         std::filesystem::path source = result["file"].as<std::string>();
-    //         Scanner scanner = Scanner(slurp_file(source));
-    //         scanner.scan_tokens();
-    //         scanner.debug();
-    //     } else if (result.count("repl")) {
-    //         repl();
-    //     }
-    // } catch (const std::exception &e) {
-    //     std::cerr << "Error parsing arguments: " << e.what() << std::endl;
-    //     exit(64);
-    // }
+        "f,file", "Lox Script", cxxopts::value<std::string>())(
+        "t,tokens", "Print the tokens the compiler sees for a script",
+        cxxopts::value<std::string>())("d,disassemble", "Print the bytecode before running it")(
+        "gc-stress", "Run a garbage collection on every allocation")(
+        "gc-log", "Log every garbage collection to stderr")(
+        "max-frames", "Deepest call nesting before a stack overflow",
+        cxxopts::value<std::size_t>()->default_value(std::to_string(VM::DEFAULT_MAX_FRAMES)))(
+        "batch", "Run every script in a directory or listed in a file",
+        cxxopts::value<std::string>())("j,jobs", "Worker threads for --batch, 0 uses every core",
+                                       cxxopts::value<unsigned>()->default_value("0"));
+
+    try {
+        // We can now parse our options
+        auto result{options.parse(argc, argv)};
+
+        if (result.count("help")) {
+            std::cout << options.help() << std::endl;
+        } else if (result.count("file")) {
+            RunOptions run_options;
+            run_options.disassemble = result.count("disassemble") > 0;
+            run_options.gc_stress = result.count("gc-stress") > 0;
+            run_options.gc_log = result.count("gc-log") > 0;
+            run_options.max_frames = result["max-frames"].as<std::size_t>();
+            run_file(result["file"].as<std::string>(), run_options);
+        } else if (result.count("tokens")) {
+            std::string source = slurp_file(result["tokens"].as<std::string>());
+            Scanner scanner = Scanner(source);
+            for (const Token &token : scanner.scan_tokens()) {
+                fmt::println("{}", token.type_);
+            }
+        } else if (result.count("batch")) {
+            return run_batch(result["batch"].as<std::string>(), result["jobs"].as<unsigned>());
+        } else if (result.count("repl")) {
+            repl();
+        }
+    } catch (const std::exception &e) {
+        std::cerr << "Error parsing arguments: " << e.what() << std::endl;
+        exit(64);
+    }
     return 0;
-}
\ No newline at end of file
+}
@@ -1,39 +1,20 @@
 #include "chunk/chunk.hpp"
 
+#include "object/object.hpp"
+
 // This function formats the OpCode into a string form that makes it easier
 // to dissassemble code using fmt
-inline auto fmt::formatter<OpCode>::format(OpCode op_code, format_context &ctx) const
+auto fmt::formatter<OpCode>::format(OpCode op_code, format_context &ctx) const
     -> format_context::iterator {
     string_view name = "Unknown opcode";
     switch (op_code) {
-    case OpCode::OP_RETURN: {
-        name = "OP_RETURN";
-        break;
-    }
-    case OpCode::OP_CONSTANT: {
-        name = "OP_CONSTANT";
-        break;
-    }
-    case OpCode::OP_NEGATE: {
-        name = "OP_NEGATE";
-        break;
-    }
-    case OpCode::OP_ADD: {
-        name = "OP_ADD";
-        break;
-    }
-    case OpCode::OP_SUBTRACT: {
-        name = "OP_SUBTRACT";
-        break;
-    }
-    case OpCode::OP_DIVIDE: {
-        name = "OP_DIVIDE";
-        break;
-    }
-    case OpCode::OP_MULTIPLY: {
-        name = "OP_MULTIPLY";
-        break;
+#define CLOX_OPCODE_NAME(op)                                                                   \
+    case OpCode::op: {                                                                         \
+        name = #op;                                                                            \
+        break;                                                                                 \
     }
+        CLOX_OPCODES(CLOX_OPCODE_NAME)
+#undef CLOX_OPCODE_NAME
     }
     return formatter<string_view>::format(name, ctx);
 }
@@ -55,16 +36,12 @@ void Chunk::write_chunk(std::uint8_t byte, int line) {
     lines_.push_back(line);
 }
 
-// Function to add constant values to our constants vector
+// Function to add constant values to our constants vector, returns its index
 int Chunk::add_constant(Value value) {
     // We use the wrapper method to append the value
     constants_.write_value_array(value);
-    // We use find to get the location of the element
-    auto it = std::find(constants_.values.begin(), constants_.values.end(), value);
-    // We then use the distance algorithm to calculate the location of the element
-    int index = std::distance(constants_.values.begin(), it);
-    // We can then return that index
-    return index;
+    // The new value is always the last one
+    return static_cast<int>(constants_.values.size() - 1);
 }
 
 void Chunk::dissasemble() {
@@ -73,77 +50,130 @@ void Chunk::dissasemble() {
     fmt::print("{:=^30}\n", name_);
 
     // We loop the items in the vector and print to screen
-    for (int it = 0; it < code_.size(); /* NO INCREMENT */) {
+    for (std::size_t it = 0; it < code_.size(); /* NO INCREMENT */) {
+        it = dissasemble_instruction(it);
+    }
+}
 
-        // We print the bytecode offset
-        fmt::print("{:04d} ", it);
+std::size_t Chunk::dissasemble_instruction(std::size_t it) {
+    // We print the bytecode offset
+    fmt::print("{:04d} ", it);
 
-        // We track the line number in our lines vector
-        // We compare the current line to the previous line
-        if (it > 0 && lines_[it] == lines_[it - 1]) {
-            // We print the continuation marker
-            fmt::print("   | ");
-            // We print the new line number
-        } else {
-            fmt::print("{:4d} ", lines_[it]);
-        }
+    // We track the line number in our lines vector
+    // We compare the current line to the previous line
+    if (it > 0 && lines_[it] == lines_[it - 1]) {
+        // We print the continuation marker
+        fmt::print("   | ");
+        // We print the new line number
+    } else {
+        fmt::print("{:4d} ", lines_[it]);
+    }
 
-        // We need to cast the byte back to an OpCode so we can catch it in the
-        // switch statement
-        OpCode instruction = static_cast<OpCode>(code_[it]);
-        switch (instruction) {
-        case OpCode::OP_RETURN: {
-            fmt::print("{}\n", instruction);
-            // Instruction is 1 byte so we advance forward
-            it += 1;
-            break;
-        }
-        case OpCode::OP_CONSTANT: {
-            // Since opcodes are two bytes long, we check if the next byte
-            // is out of bounds, if so then we assume that no constant value was
-            // passed in
-            if (it + 1 >= code_.size()) {
-                fmt::print(stderr, "Error: OP_CONSTANT missing operand.\n");
-                return;
-            }
-            // We get the constant index by looking ahead
-            std::uint8_t constant_index = code_[it + 1];
-            fmt::print("{} {:>12} {}\n", instruction, constant_index,
-                       constants_.values[constant_index]);
-            // We now need to advance past the opcode and constant value
-            it += 2;
-            break;
-        }
-        case OpCode::OP_ADD: {
-            fmt::print("{}\n", instruction);
-            it += 1;
-            break;
-        }
-        case OpCode::OP_SUBTRACT: {
-            fmt::print("{}\n", instruction);
-            it += 1;
-            break;
+    // We need to cast the byte back to an OpCode so we can catch it in the
+    // switch statement
+    OpCode instruction = static_cast<OpCode>(code_[it]);
+    switch (instruction) {
+    case OpCode::OP_CONSTANT: {
+        // Since opcodes are two bytes long, we check if the next byte
+        // is out of bounds, if so then we assume that no constant value was
+        // passed in
+        if (it + 1 >= code_.size()) {
+            fmt::print(stderr, "Error: OP_CONSTANT missing operand.\n");
+            return code_.size();
         }
-        case OpCode::OP_MULTIPLY: {
-            fmt::print("{}\n", instruction);
-            it += 1;
-            break;
+        // We get the constant index by looking ahead
+        std::uint8_t constant_index = code_[it + 1];
+        fmt::print("{} {:>12} {}\n", instruction, constant_index,
+                   constants_.values[constant_index]);
+        // We now need to advance past the opcode and constant value
+        return it + 2;
+    }
+    case OpCode::OP_JUMP:
+    case OpCode::OP_JUMP_IF_FALSE: {
+        if (it + 2 >= code_.size()) {
+            fmt::print(stderr, "Error: {} missing operand.\n", instruction);
+            return code_.size();
         }
-        case OpCode::OP_DIVIDE: {
-            fmt::print("{}\n", instruction);
-            it += 1;
-            break;
+        // We show where the jump lands rather than the raw offset
+        std::size_t offset = static_cast<std::size_t>(code_[it + 1] << 8 | code_[it + 2]);
+        fmt::print("{} {:>12} -> {}\n", instruction, it, it + 3 + offset);
+        return it + 3;
+    }
+    case OpCode::OP_GET_LOCAL:
+    case OpCode::OP_SET_LOCAL:
+    case OpCode::OP_POPN:
+    case OpCode::OP_CALL:
+    case OpCode::OP_GET_UPVALUE:
+    case OpCode::OP_SET_UPVALUE:
+    case OpCode::OP_GET_UPVALUE_COPY: {
+        if (it + 1 >= code_.size()) {
+            fmt::print(stderr, "Error: {} missing operand.\n", instruction);
+            return code_.size();
         }
-        case OpCode::OP_NEGATE: {
-            fmt::print("{}\n", instruction);
-            it += 1;
-            break;
+        fmt::print("{} {:>12}\n", instruction, code_[it + 1]);
+        return it + 2;
+    }
+    case OpCode::OP_GET_LOCAL_LONG:
+    case OpCode::OP_SET_LOCAL_LONG:
+    case OpCode::OP_DEFINE_GLOBAL:
+    case OpCode::OP_GET_GLOBAL:
+    case OpCode::OP_SET_GLOBAL: {
+        if (it + 2 >= code_.size()) {
+            fmt::print(stderr, "Error: {} missing operand.\n", instruction);
+            return code_.size();
         }
-        default: {
-            fmt::print("UNKNOWN_OPCODE ({})\n", code_[it]);
-            it += 1;
-            break;
+        std::size_t slot = static_cast<std::size_t>(code_[it + 1] << 8 | code_[it + 2]);
+        fmt::print("{} {:>12}\n", instruction, slot);
+        return it + 3;
+    }
+    case OpCode::OP_CLOSURE: {
+        if (it + 1 >= code_.size()) {
+            fmt::print(stderr, "Error: OP_CLOSURE missing operand.\n");
+            return code_.size();
         }
+        std::uint8_t constant_index = code_[it + 1];
+        Value function = constants_.values[constant_index];
+        fmt::print("{} {:>12} {}\n", instruction, constant_index, function);
+        it += 2;
+        // Every upvalue gets a line of its own saying where it comes from
+        for (int upvalue = 0; upvalue < as_function(function)->upvalue_count_; ++upvalue) {
+            if (it + 2 >= code_.size()) {
+                fmt::print(stderr, "Error: OP_CLOSURE missing upvalue.\n");
+                return code_.size();
+            }
+            std::string_view kind = "upvalue";
+            if (static_cast<CaptureKind>(code_[it]) == CaptureKind::CAPTURE_COPY) {
+                kind = "copy";
+            } else if (static_cast<CaptureKind>(code_[it]) == CaptureKind::CAPTURE_BOX) {
+                kind = "box";
+            }
+            std::size_t index = static_cast<std::size_t>(code_[it + 1] << 8 | code_[it + 2]);
+            fmt::print("{:04d}    |                     {} {}\n", it, kind, index);
+            it += 3;
         }
+        return it;
     }
-}
\ No newline at end of file
+    case OpCode::OP_CLOSE_UPVALUE:
+    case OpCode::OP_RETURN:
+    case OpCode::OP_PRINT:
+    case OpCode::OP_NIL:
+    case OpCode::OP_TRUE:
+    case OpCode::OP_FALSE:
+    case OpCode::OP_POP:
+    case OpCode::OP_EQUAL:
+    case OpCode::OP_GREATER:
+    case OpCode::OP_LESS:
+    case OpCode::OP_ADD:
+    case OpCode::OP_SUBTRACT:
+    case OpCode::OP_MULTIPLY:
+    case OpCode::OP_DIVIDE:
+    case OpCode::OP_NOT:
+    case OpCode::OP_NEGATE: {
+        // Simple instructions are a single byte
+        fmt::print("{}\n", instruction);
+        return it + 1;
+    }
+    }
+    fmt::print("UNKNOWN_OPCODE ({})\n", code_[it]);
+    return it + 1;
+}
@@ -12,15 +12,64 @@
  * operation code but we will use OpCode as a shorthand.
  */
 
+// Every opcode in encoding order. The enum, the opcode names and the VM's
+// dispatch table are all generated from this list so they can not drift apart.
+// Jumps carry a 16 bit big endian offset from the end of the instruction and
+// the global variable opcodes a 16 bit big endian slot. Local variable opcodes
+// carry a one byte stack slot, with _LONG variants taking 16 bits for big
+// functions, OP_POPN a one byte count and OP_CALL a one byte argument count.
+// Upvalue opcodes carry a one byte upvalue index. OP_CLOSURE carries a one
+// byte function constant followed by three bytes per upvalue of the function,
+// a CaptureKind and a 16 bit big endian index.
+#define CLOX_OPCODES(X)                                                                       \
+    X(OP_RETURN)                                                                              \
+    X(OP_CONSTANT)                                                                            \
+    X(OP_NIL)                                                                                 \
+    X(OP_TRUE)                                                                                \
+    X(OP_FALSE)                                                                               \
+    X(OP_POP)                                                                                 \
+    X(OP_EQUAL)                                                                               \
+    X(OP_GREATER)                                                                             \
+    X(OP_LESS)                                                                                \
+    X(OP_ADD)                                                                                 \
+    X(OP_SUBTRACT)                                                                            \
+    X(OP_MULTIPLY)                                                                            \
+    X(OP_DIVIDE)                                                                              \
+    X(OP_NOT)                                                                                 \
+    X(OP_NEGATE)                                                                              \
+    X(OP_JUMP)                                                                                \
+    X(OP_JUMP_IF_FALSE)                                                                       \
+    X(OP_PRINT)                                                                               \
+    X(OP_DEFINE_GLOBAL)                                                                       \
+    X(OP_GET_GLOBAL)                                                                          \
+    X(OP_SET_GLOBAL)                                                                          \
+    X(OP_GET_LOCAL)                                                                           \
+    X(OP_SET_LOCAL)                                                                           \
+    X(OP_GET_LOCAL_LONG)                                                                      \
+    X(OP_SET_LOCAL_LONG)                                                                      \
+    X(OP_POPN)                                                                                \
+    X(OP_CALL)                                                                                \
+    X(OP_CLOSURE)                                                                             \
+    X(OP_GET_UPVALUE)                                                                         \
+    X(OP_SET_UPVALUE)                                                                         \
+    X(OP_GET_UPVALUE_COPY)                                                                    \
+    X(OP_CLOSE_UPVALUE)
+
 // I am opting for a scoped enum since they are a bit safer
 enum class OpCode {
-    OP_RETURN,
-    OP_CONSTANT,
-    OP_ADD,
-    OP_SUBTRACT,
-    OP_MULTIPLY,
-    OP_DIVIDE,
-    OP_NEGATE
+#define CLOX_OPCODE_ENUM(name) name,
+    CLOX_OPCODES(CLOX_OPCODE_ENUM)
+#undef CLOX_OPCODE_ENUM
+};
+
+// How OP_CLOSURE fills in each upvalue of the new closure
+enum class CaptureKind : std::uint8_t {
+    // Take the upvalue at the index from the enclosing closure as it is
+    CAPTURE_ENCLOSING,
+    // Copy the local at the slot, it is never reassigned
+    CAPTURE_COPY,
+    // Share the local at the slot through an ObjUpvalue
+    CAPTURE_BOX
 };
 
 // We create a custom formatter for our enum class
@@ -36,6 +85,8 @@ struct Chunk {
     void write_chunk(std::uint8_t byte, int line);
     int add_constant(Value value);
     void dissasemble();
+    // Function to print a single instruction, returns the offset of the next one
+    std::size_t dissasemble_instruction(std::size_t offset);
     // C++ has a dynamic array already as a vector so count and capacity are
     // redundant for now
     std::string name_;
@@ -2,30 +2,685 @@
 
 #include "compiler.hpp"
 
-Compiler::Compiler(std::string source) : source_{source} {}
+#include <limits>
 
-void Compiler::compile() {
+Compiler::Compiler(std::string source, Heap &heap, Globals &globals)
+    : source_{source}, heap_(heap), globals_(globals) {}
+
+ObjFunction *Compiler::compile() {
     // We create a scanner instance and populate our tokens vector
     Scanner scanner = Scanner(source_);
     toks_ = scanner.scan_tokens();
-    // We can then compile the tokens into bytecode for usage in the vm
+    current_ = 0;
+    heap_.add_roots(this);
+    // We can then compile the tokens into bytecode for usage in the vm, the
+    // top level code becomes the body of an implicit script function
+    FunctionState script;
+    begin_function(script, FunctionType::TYPE_SCRIPT);
     while (!is_end()) {
-        try {
+        declaration();
+    }
+    ObjFunction *function = end_function();
+    heap_.remove_roots(this);
+    if (had_error_) {
+        return nullptr;
+    }
+    // Captures are patched up to the end of their scope, so we only print the
+    // bytecode once everything is compiled
+    if (disassemble_) {
+        disassemble(function);
+    }
+    return function;
+}
+
+// Function to print a function's bytecode after that of the functions it declares
+void Compiler::disassemble(ObjFunction *function) {
+    for (Value constant : function->chunk_.constants_.values) {
+        if (is_function(constant)) {
+            disassemble(as_function(constant));
+        }
+    }
+    function->chunk_.dissasemble();
+}
+
+// Function to start compiling a new function nested in the current one
+void Compiler::begin_function(FunctionState &state, FunctionType type) {
+    state.enclosing_ = current_fn_;
+    state.type_ = type;
+    state.function_ = heap_.allocate<ObjFunction>();
+    // We link the state in before allocating the name so the collector sees the function
+    current_fn_ = &state;
+    if (type == FunctionType::TYPE_SCRIPT) {
+        state.function_->chunk_.name_ = "script";
+    } else {
+        state.function_->name_ = heap_.intern(previous().lexeme_);
+        state.function_->chunk_.name_ = previous().lexeme_;
+    }
+    // Slot 0 belongs to the callee, the empty name means scripts can never refer to it
+    state.locals_.push_back(Local{Token{TokenType::IDENTIFIER, "", previous().line_}, 0});
+}
+
+// Function to finish the current function and hand control back to the enclosing one
+ObjFunction *Compiler::end_function() {
+    emit_return();
+    // Returning closes whatever is still captured, but the captures themselves
+    // still have to be settled
+    for (Local &local : current_fn_->locals_) {
+        settle_captures(local);
+    }
+    ObjFunction *function = current_fn_->function_;
+    current_fn_ = current_fn_->enclosing_;
+    return function;
+}
+
+// Errors are reported per declaration, we then skip ahead and carry on
+void Compiler::declaration() {
+    try {
+        if (match(TokenType::FUN)) {
+            fun_declaration();
+        } else if (match(TokenType::VAR)) {
+            var_declaration();
+        } else {
+            statement();
+        }
+    } catch (CompilerError &e) {
+        report_error(e);
+        // A local whose declaration failed still counts as declared, so later
+        // uses of it don't report a second error
+        if (current_fn_->locals_.back().depth_ == -1) {
+            mark_initialized();
+        }
+        synchronize();
+    }
+}
+
+void Compiler::var_declaration() {
+    consume(TokenType::IDENTIFIER, "Expect variable name.");
+    Token name = previous();
+    declare_variable();
+    if (match(TokenType::EQUAL)) {
+        expression();
+    } else {
+        emit_op(OpCode::OP_NIL);
+    }
+    consume(TokenType::SEMICOLON, "Expect ';' after variable declaration.");
+
+    // A local's value is already sitting in its slot, it only becomes visible now
+    if (current_fn_->scope_depth_ > 0) {
+        mark_initialized();
+        return;
+    }
+    emit_global(OpCode::OP_DEFINE_GLOBAL, global_slot(name));
+}
+
+void Compiler::fun_declaration() {
+    consume(TokenType::IDENTIFIER, "Expect function name.");
+    Token name = previous();
+    declare_variable();
+    // Unlike a variable a function may refer to itself, so it is visible before its body
+    mark_initialized();
+    function(FunctionType::TYPE_FUNCTION);
+    if (current_fn_->scope_depth_ == 0) {
+        emit_global(OpCode::OP_DEFINE_GLOBAL, global_slot(name));
+    }
+}
+
+void Compiler::function(FunctionType type) {
+    FunctionState state;
+    begin_function(state, type);
+    try {
+        // Parameters are the first locals of the body, the caller leaves the
+        // arguments right where their slots are
+        begin_scope();
+        consume(TokenType::LEFT_PAREN, "Expect '(' after function name.");
+        if (!check(TokenType::RIGHT_PAREN)) {
+            do {
+                if (current_fn_->function_->arity_ == std::numeric_limits<std::uint8_t>::max()) {
+                    throw CompilerError{"Can't have more than 255 parameters.", peek()};
+                }
+                ++current_fn_->function_->arity_;
+                consume(TokenType::IDENTIFIER, "Expect parameter name.");
+                declare_variable();
+                mark_initialized();
+            } while (match(TokenType::COMMA));
+        }
+        consume(TokenType::RIGHT_PAREN, "Expect ')' after parameters.");
+        consume(TokenType::LEFT_BRACE, "Expect '{' before function body.");
+        block();
+    } catch (CompilerError &) {
+        // The state lives on our stack, so it must not outlive an error either
+        current_fn_ = state.enclosing_;
+        throw;
+    }
+    // Returning drops the whole frame, so the scope needs no end_scope
+    ObjFunction *function = end_function();
+    emit_op(OpCode::OP_CLOSURE);
+    emit_byte(make_constant(Value::obj(function)));
+    for (const Upvalue &upvalue : state.upvalues_) {
+        CaptureKind kind = CaptureKind::CAPTURE_ENCLOSING;
+        if (upvalue.is_local_) {
+            Local &local = current_fn_->locals_[upvalue.index_];
+            if (local.assigned_) {
+                kind = CaptureKind::CAPTURE_BOX;
+            } else {
+                kind = CaptureKind::CAPTURE_COPY;
+                local.copy_sites_.push_back(
+                    CopySite{&current_chunk(), current_chunk().code_.size(),
+                             static_cast<std::uint8_t>(CaptureKind::CAPTURE_BOX)});
+            }
+        }
+        emit_byte(static_cast<std::uint8_t>(kind));
+        emit_byte(static_cast<std::uint8_t>((upvalue.index_ >> 8) & 0xff));
+        emit_byte(static_cast<std::uint8_t>(upvalue.index_ & 0xff));
+    }
+}
+
+void Compiler::statement() {
+    if (match(TokenType::PRINT)) {
+        print_statement();
+    } else if (match(TokenType::RETURN)) {
+        return_statement();
+    } else if (match(TokenType::LEFT_BRACE)) {
+        begin_scope();
+        block();
+        end_scope();
+    } else {
+        expression_statement();
+    }
+}
+
+void Compiler::block() {
+    while (!check(TokenType::RIGHT_BRACE) && !is_end()) {
+        declaration();
+    }
+    consume(TokenType::RIGHT_BRACE, "Expect '}' after block.");
+}
+
+void Compiler::begin_scope() { ++current_fn_->scope_depth_; }
+
+// Function to drop the locals of the scope we are leaving. Plain slots are
+// popped in batches, only boxed captures need closing one by one
+void Compiler::end_scope() {
+    --current_fn_->scope_depth_;
+    std::vector<Local> &locals = current_fn_->locals_;
+    std::size_t count = 0;
+    while (!locals.empty() && locals.back().depth_ > current_fn_->scope_depth_) {
+        Local &local = locals.back();
+        settle_captures(local);
+        if (local.captured_ && local.assigned_) {
+            emit_pops(count);
+            count = 0;
+            emit_op(OpCode::OP_CLOSE_UPVALUE);
+        } else {
+            ++count;
+        }
+        locals.pop_back();
+    }
+    emit_pops(count);
+}
+
+void Compiler::settle_captures(Local &local) {
+    // After an error nothing runs, and a function we abandoned half way may
+    // already be freed along with its sites
+    if (!local.assigned_ || had_error_) {
+        return;
+    }
+    for (const CopySite &site : local.copy_sites_) {
+        site.chunk_->code_[site.offset_] = site.boxed_;
+    }
+    local.copy_sites_.clear();
+}
+
+void Compiler::print_statement() {
+    expression();
+    consume(TokenType::SEMICOLON, "Expect ';' after value.");
+    emit_op(OpCode::OP_PRINT);
+}
+
+void Compiler::return_statement() {
+    if (current_fn_->type_ == FunctionType::TYPE_SCRIPT) {
+        throw CompilerError{"Can't return from top-level code.", previous()};
+    }
+    if (match(TokenType::SEMICOLON)) {
+        emit_return();
+        return;
+    }
+    expression();
+    consume(TokenType::SEMICOLON, "Expect ';' after return value.");
+    emit_op(OpCode::OP_RETURN);
+}
+
+// The value of an expression statement is thrown away
+void Compiler::expression_statement() {
+    expression();
+    consume(TokenType::SEMICOLON, "Expect ';' after expression.");
+    emit_op(OpCode::OP_POP);
+}
+
+void Compiler::expression() { parse_precedence(Precedence::PREC_ASSIGNMENT); }
+
+// Main logic of the Pratt parser, we parse anything that binds at least as
+// tightly as the given precedence
+void Compiler::parse_precedence(Precedence precedence) {
+    // The first token always starts a prefix expression
+    Token &token = advance();
+    ParseFn prefix = get_rule(token.type_).prefix_;
+    if (prefix == nullptr) {
+        throw CompilerError{"Expect expression.", token};
+    }
+    // Only a low precedence context may assign, so a + b = c is not parsed as a + (b = c)
+    bool can_assign = precedence <= Precedence::PREC_ASSIGNMENT;
+    can_assign_ = can_assign;
+    (this->*prefix)();
+
+    // We then keep folding infix operators in for as long as they bind tightly enough
+    while (precedence <= get_rule(peek().type_).precedence_) {
+        ParseFn infix = get_rule(advance().type_).infix_;
+        (this->*infix)();
+    }
+
+    // Anything that could have assigned already consumed the =
+    if (can_assign && match(TokenType::EQUAL)) {
+        throw CompilerError{"Invalid assignment target.", previous()};
+    }
+}
+
+// The Pratt table, tokens without a rule cannot appear in an expression
+ParseRule Compiler::get_rule(TokenType type) {
+    switch (type) {
+    case TokenType::LEFT_PAREN:
+        return {&Compiler::grouping, &Compiler::call, Precedence::PREC_CALL};
+    case TokenType::MINUS:
+        return {&Compiler::unary, &Compiler::binary, Precedence::PREC_TERM};
+    case TokenType::PLUS:
+        return {nullptr, &Compiler::binary, Precedence::PREC_TERM};
+    case TokenType::SLASH:
+    case TokenType::STAR:
+        return {nullptr, &Compiler::binary, Precedence::PREC_FACTOR};
+    case TokenType::BANG:
+        return {&Compiler::unary, nullptr, Precedence::PREC_NONE};
+    case TokenType::BANG_EQUAL:
+    case TokenType::EQUAL_EQUAL:
+        return {nullptr, &Compiler::binary, Precedence::PREC_EQUALITY};
+    case TokenType::GREATER:
+    case TokenType::GREATER_EQUAL:
+    case TokenType::LESS:
+    case TokenType::LESS_EQUAL:
+        return {nullptr, &Compiler::binary, Precedence::PREC_COMPARISON};
+    case TokenType::QUESTION:
+        return {nullptr, &Compiler::conditional, Precedence::PREC_CONDITIONAL};
+    case TokenType::AND:
+        return {nullptr, &Compiler::and_, Precedence::PREC_AND};
+    case TokenType::OR:
+        return {nullptr, &Compiler::or_, Precedence::PREC_OR};
+    case TokenType::NUMBER:
+        return {&Compiler::number, nullptr, Precedence::PREC_NONE};
+    case TokenType::STRING:
+        return {&Compiler::string, nullptr, Precedence::PREC_NONE};
+    case TokenType::IDENTIFIER:
+        return {&Compiler::variable, nullptr, Precedence::PREC_NONE};
+    case TokenType::FALSE:
+    case TokenType::TRUE:
+    case TokenType::NIL:
+        return {&Compiler::literal, nullptr, Precedence::PREC_NONE};
+    default:
+        return {nullptr, nullptr, Precedence::PREC_NONE};
+    }
+}
+
+void Compiler::number() { emit_constant(Value::number(std::stod(previous().lexeme_))); }
+
+void Compiler::string() {
+    // The lexeme still has its quotes, Lox strings have no escapes to handle
+    const std::string &lexeme = previous().lexeme_;
+    ObjString *string = heap_.intern(lexeme.substr(1, lexeme.size() - 2));
+    emit_constant(Value::obj(string));
+}
+
+void Compiler::variable() {
+    // We read the flag before parsing anything else can overwrite it
+    bool can_assign = can_assign_;
+    Token name = previous();
+    int local = resolve_local(current_fn_, name);
+    int upvalue = local < 0 ? resolve_upvalue(current_fn_, name) : -1;
+    bool assign = can_assign && match(TokenType::EQUAL);
+    if (assign) {
+        expression();
+    }
+
+    if (local >= 0) {
+        std::size_t slot = static_cast<std::size_t>(local);
+        if (assign) {
+            current_fn_->locals_[slot].assigned_ = true;
+            emit_local(OpCode::OP_SET_LOCAL, OpCode::OP_SET_LOCAL_LONG, slot);
+        } else {
+            emit_local(OpCode::OP_GET_LOCAL, OpCode::OP_GET_LOCAL_LONG, slot);
+        }
+    } else if (upvalue >= 0) {
+        const Upvalue &captured = current_fn_->upvalues_[static_cast<std::size_t>(upvalue)];
+        Local &origin = captured.origin_->locals_[captured.slot_];
+        if (assign) {
+            origin.assigned_ = true;
+            emit_op(OpCode::OP_SET_UPVALUE);
+        } else if (origin.assigned_) {
+            emit_op(OpCode::OP_GET_UPVALUE);
+        } else {
+            origin.copy_sites_.push_back(
+                CopySite{&current_chunk(), current_chunk().code_.size(),
+                         static_cast<std::uint8_t>(OpCode::OP_GET_UPVALUE)});
+            emit_op(OpCode::OP_GET_UPVALUE_COPY);
+        }
+        emit_byte(static_cast<std::uint8_t>(upvalue));
+    } else {
+        emit_global(assign ? OpCode::OP_SET_GLOBAL : OpCode::OP_GET_GLOBAL, global_slot(name));
+    }
+}
+
+void Compiler::literal() {
+    switch (previous().type_) {
+    case TokenType::FALSE:
+        emit_op(OpCode::OP_FALSE);
+        break;
+    case TokenType::TRUE:
+        emit_op(OpCode::OP_TRUE);
+        break;
+    case TokenType::NIL:
+        emit_op(OpCode::OP_NIL);
+        break;
+    default:
+        break;
+    }
+}
+
+void Compiler::grouping() {
+    expression();
+    consume(TokenType::RIGHT_PAREN, "Expect ')' after expression.");
+}
+
+void Compiler::unary() {
+    TokenType op = previous().type_;
+    // We compile the operand first so its value is on the stack
+    parse_precedence(Precedence::PREC_UNARY);
+    if (op == TokenType::MINUS) {
+        emit_op(OpCode::OP_NEGATE);
+    } else {
+        emit_op(OpCode::OP_NOT);
+    }
+}
+
+void Compiler::binary() {
+    TokenType op = previous().type_;
+    // The right operand binds one level tighter, so operators are left associative
+    Precedence precedence = get_rule(op).precedence_;
+    parse_precedence(static_cast<Precedence>(static_cast<int>(precedence) + 1));
+
+    // We only have three comparison opcodes, the rest are their negations
+    switch (op) {
+    case TokenType::BANG_EQUAL:
+        emit_op(OpCode::OP_EQUAL);
+        emit_op(OpCode::OP_NOT);
+        break;
+    case TokenType::EQUAL_EQUAL:
+        emit_op(OpCode::OP_EQUAL);
+        break;
+    case TokenType::GREATER:
+        emit_op(OpCode::OP_GREATER);
+        break;
+    case TokenType::GREATER_EQUAL:
+        emit_op(OpCode::OP_LESS);
+        emit_op(OpCode::OP_NOT);
+        break;
+    case TokenType::LESS:
+        emit_op(OpCode::OP_LESS);
+        break;
+    case TokenType::LESS_EQUAL:
+        emit_op(OpCode::OP_GREATER);
+        emit_op(OpCode::OP_NOT);
+        break;
+    case TokenType::PLUS:
+        emit_op(OpCode::OP_ADD);
+        break;
+    case TokenType::MINUS:
+        emit_op(OpCode::OP_SUBTRACT);
+        break;
+    case TokenType::STAR:
+        emit_op(OpCode::OP_MULTIPLY);
+        break;
+    case TokenType::SLASH:
+        emit_op(OpCode::OP_DIVIDE);
+        break;
+    default:
+        break;
+    }
+}
+
+// and short circuits, if the left side is falsey it is the result
+void Compiler::and_() {
+    std::size_t end_jump = emit_jump(OpCode::OP_JUMP_IF_FALSE);
+    emit_op(OpCode::OP_POP);
+    parse_precedence(Precedence::PREC_AND);
+    patch_jump(end_jump);
+}
+
+// or short circuits, if the left side is truthy it is the result
+void Compiler::or_() {
+    std::size_t else_jump = emit_jump(OpCode::OP_JUMP_IF_FALSE);
+    std::size_t end_jump = emit_jump(OpCode::OP_JUMP);
+    patch_jump(else_jump);
+    emit_op(OpCode::OP_POP);
+    parse_precedence(Precedence::PREC_OR);
+    patch_jump(end_jump);
+}
+
+// The ternary, only one of the two branches is evaluated
+void Compiler::conditional() {
+    std::size_t else_jump = emit_jump(OpCode::OP_JUMP_IF_FALSE);
+    emit_op(OpCode::OP_POP);
+    expression();
+    consume(TokenType::COLON, "Expected ':'.");
+    std::size_t end_jump = emit_jump(OpCode::OP_JUMP);
+    patch_jump(else_jump);
+    emit_op(OpCode::OP_POP);
+    // The else branch parses at our own level so nested ternaries group to the right
+    parse_precedence(Precedence::PREC_CONDITIONAL);
+    patch_jump(end_jump);
+}
+
+// A call is an infix ( after the callee, which is already on the stack below the arguments
+void Compiler::call() {
+    std::uint8_t arg_count = argument_list();
+    emit_op(OpCode::OP_CALL);
+    emit_byte(arg_count);
+}
+
+std::uint8_t Compiler::argument_list() {
+    std::uint8_t arg_count = 0;
+    if (!check(TokenType::RIGHT_PAREN)) {
+        do {
             expression();
-        } catch (CompilerError &e) {
-            report_error(e);
+            if (arg_count == std::numeric_limits<std::uint8_t>::max()) {
+                throw CompilerError{"Can't have more than 255 arguments.", previous()};
+            }
+            ++arg_count;
+        } while (match(TokenType::COMMA));
+    }
+    consume(TokenType::RIGHT_PAREN, "Expect ')' after arguments.");
+    return arg_count;
+}
+
+Chunk &Compiler::current_chunk() { return current_fn_->function_->chunk_; }
+
+// Bytecode gets the line of the last token we consumed
+void Compiler::emit_byte(std::uint8_t byte) { current_chunk().write_chunk(byte, previous().line_); }
+
+void Compiler::emit_op(OpCode op) { current_chunk().write_chunk(op, previous().line_); }
+
+std::uint8_t Compiler::make_constant(Value value) {
+    int index = current_chunk().add_constant(value);
+    // Constant operands are a single byte
+    if (index > std::numeric_limits<std::uint8_t>::max()) {
+        throw CompilerError{"Too many constants in one chunk.", previous()};
+    }
+    return static_cast<std::uint8_t>(index);
+}
+
+void Compiler::emit_constant(Value value) {
+    std::uint8_t index = make_constant(value);
+    emit_op(OpCode::OP_CONSTANT);
+    emit_byte(index);
+}
+
+void Compiler::emit_pops(std::size_t count) {
+    while (count > 0) {
+        std::size_t batch = std::min<std::size_t>(count, std::numeric_limits<std::uint8_t>::max());
+        if (batch == 1) {
+            emit_op(OpCode::OP_POP);
+        } else {
+            emit_op(OpCode::OP_POPN);
+            emit_byte(static_cast<std::uint8_t>(batch));
         }
+        count -= batch;
     }
-    //consume(TokenType::eof, "Expeected the end of an expression.");
 }
 
-void Compiler::expression() {
-    if (!is_end()) {
-        fmt::println("{}", advance().type_);
+void Compiler::emit_return() {
+    emit_op(OpCode::OP_NIL);
+    emit_op(OpCode::OP_RETURN);
+}
+
+// Function to emit a jump with a placeholder offset, returns where to patch it
+std::size_t Compiler::emit_jump(OpCode op) {
+    emit_op(op);
+    emit_byte(0xff);
+    emit_byte(0xff);
+    return current_chunk().code_.size() - 2;
+}
+
+// Function to point a jump at the next instruction we are going to emit
+void Compiler::patch_jump(std::size_t offset) {
+    std::size_t jump = current_chunk().code_.size() - offset - 2;
+    if (jump > std::numeric_limits<std::uint16_t>::max()) {
+        throw CompilerError{"Too much code to jump over.", previous()};
+    }
+    current_chunk().code_[offset] = static_cast<std::uint8_t>((jump >> 8) & 0xff);
+    current_chunk().code_[offset + 1] = static_cast<std::uint8_t>(jump & 0xff);
+}
+
+void Compiler::emit_global(OpCode op, std::uint16_t slot) {
+    emit_op(op);
+    emit_byte(static_cast<std::uint8_t>((slot >> 8) & 0xff));
+    emit_byte(static_cast<std::uint8_t>(slot & 0xff));
+}
+
+void Compiler::emit_local(OpCode op, OpCode long_op, std::size_t slot) {
+    if (slot <= std::numeric_limits<std::uint8_t>::max()) {
+        emit_op(op);
+        emit_byte(static_cast<std::uint8_t>(slot));
+    } else {
+        emit_op(long_op);
+        emit_byte(static_cast<std::uint8_t>((slot >> 8) & 0xff));
+        emit_byte(static_cast<std::uint8_t>(slot & 0xff));
+    }
+}
+
+int Compiler::resolve_local(FunctionState *state, const Token &name) {
+    const std::vector<Local> &locals = state->locals_;
+    for (std::size_t it = locals.size(); it-- > 0;) {
+        if (locals[it].name_.lexeme_ == name.lexeme_) {
+            if (locals[it].depth_ == -1) {
+                throw CompilerError{"Can't read local variable in its own initializer.", name};
+            }
+            return static_cast<int>(it);
+        }
     }
+    return -1;
+}
+
+int Compiler::resolve_upvalue(FunctionState *state, const Token &name) {
+    FunctionState *enclosing = state->enclosing_;
+    if (enclosing == nullptr) {
+        return -1;
+    }
+    int local = resolve_local(enclosing, name);
+    if (local >= 0) {
+        std::size_t slot = static_cast<std::size_t>(local);
+        enclosing->locals_[slot].captured_ = true;
+        return add_upvalue(state, Upvalue{static_cast<std::uint16_t>(slot), true, enclosing, slot},
+                           name);
+    }
+    // A variable further out is captured by every function in between, each
+    // one passing it on from its own closure
+    int upvalue = resolve_upvalue(enclosing, name);
+    if (upvalue >= 0) {
+        const Upvalue &outer = enclosing->upvalues_[static_cast<std::size_t>(upvalue)];
+        return add_upvalue(
+            state, Upvalue{static_cast<std::uint16_t>(upvalue), false, outer.origin_, outer.slot_},
+            name);
+    }
+    return -1;
+}
+
+int Compiler::add_upvalue(FunctionState *state, Upvalue upvalue, const Token &name) {
+    std::vector<Upvalue> &upvalues = state->upvalues_;
+    // A function captures each variable once however often it mentions it
+    for (std::size_t it = 0; it < upvalues.size(); ++it) {
+        if (upvalues[it].index_ == upvalue.index_ && upvalues[it].is_local_ == upvalue.is_local_) {
+            return static_cast<int>(it);
+        }
+    }
+    if (upvalues.size() > std::numeric_limits<std::uint8_t>::max()) {
+        throw CompilerError{"Too many closure variables in function.", name};
+    }
+    upvalues.push_back(upvalue);
+    ++state->function_->upvalue_count_;
+    return static_cast<int>(upvalues.size() - 1);
+}
+
+void Compiler::add_local(const Token &name) {
+    if (current_fn_->locals_.size() > std::numeric_limits<std::uint16_t>::max()) {
+        throw CompilerError{"Too many local variables in function.", name};
+    }
+    current_fn_->locals_.push_back(Local{name, -1});
+}
+
+void Compiler::declare_variable() {
+    if (current_fn_->scope_depth_ == 0) {
+        return;
+    }
+    const Token &name = previous();
+    const std::vector<Local> &locals = current_fn_->locals_;
+    // Shadowing is fine across scopes but not within one
+    for (std::size_t it = locals.size(); it-- > 0;) {
+        if (locals[it].depth_ != -1 && locals[it].depth_ < current_fn_->scope_depth_) {
+            break;
+        }
+        if (locals[it].name_.lexeme_ == name.lexeme_) {
+            throw CompilerError{"Already a variable with this name in this scope.", name};
+        }
+    }
+    add_local(name);
+}
+
+void Compiler::mark_initialized() {
+    if (current_fn_->scope_depth_ == 0) {
+        return;
+    }
+    current_fn_->locals_.back().depth_ = current_fn_->scope_depth_;
+}
+
+std::uint16_t Compiler::global_slot(const Token &name) {
+    std::size_t slot = globals_.slot_of(heap_.intern(name.lexeme_));
+    if (slot > std::numeric_limits<std::uint16_t>::max()) {
+        throw CompilerError{"Too many global variables.", name};
+    }
+    return static_cast<std::uint16_t>(slot);
 }
 
 void Compiler::consume(TokenType tok_t, std::string message) {
+    // A scanner error is more useful than whatever we expected instead
+    if (peek().type_ == TokenType::ERROR) {
+        advance();
+    }
     if (peek().type_ == tok_t) {
         advance();
         return;
@@ -34,25 +689,79 @@ void Compiler::consume(TokenType tok_t, std::string message) {
     throw CompilerError{message, peek()};
 }
 
-Token Compiler::advance() {
+// Function to consume the current token, error tokens from the scanner become
+// compile errors here
+Token &Compiler::advance() {
+    Token &token = toks_.at(current_);
+    if (token.type_ == TokenType::ERROR) {
+        throw CompilerError{token.lexeme_, token};
+    }
+    // We never move past the end of file token
     if (!is_end()) {
-        check_error();
-        return toks_.at(++current_);
+        ++current_;
     }
+    return token;
 }
 
-Token Compiler::previous() { return toks_.at(current_ - 1); }
+bool Compiler::check(TokenType tok_t) { return peek().type_ == tok_t; }
 
-void Compiler::check_error() {
-    if (toks_.at(current_ + 1).type_ == TokenType::ERROR) {
-        throw CompilerError{"Compiler error", toks_.at(current_ + 1)};
+bool Compiler::match(TokenType tok_t) {
+    if (!check(tok_t)) {
+        return false;
     }
+    advance();
+    return true;
 }
 
+Token &Compiler::previous() { return toks_.at(current_ == 0 ? 0 : current_ - 1); }
+
 void Compiler::report_error(CompilerError &error) {
-    fmt::println("{} at {}", error.what(), error.tok_.line_);
+    had_error_ = true;
+    const Token &tok = error.tok_;
+    if (tok.type_ == TokenType::eof) {
+        fmt::println(err_, "[line {}] Error at end: {}", tok.line_, error.what());
+    } else if (tok.type_ == TokenType::ERROR) {
+        // The scanner already put the message in the lexeme
+        fmt::println(err_, "[line {}] Error: {}", tok.line_, error.what());
+    } else {
+        fmt::println(err_, "[line {}] Error at '{}': {}", tok.line_, tok.lexeme_, error.what());
+    }
+}
+
+void Compiler::synchronize() {
+    // Scanner errors have to be stepped over or we would report them forever
+    if (check(TokenType::ERROR)) {
+        ++current_;
+    }
+    while (!is_end()) {
+        if (previous().type_ == TokenType::SEMICOLON) {
+            return;
+        }
+        switch (peek().type_) {
+        case TokenType::CLASS:
+        case TokenType::FUN:
+        case TokenType::VAR:
+        case TokenType::FOR:
+        case TokenType::IF:
+        case TokenType::WHILE:
+        case TokenType::PRINT:
+        case TokenType::RETURN:
+            return;
+        default:
+            break;
+        }
+        // We step directly so scanner errors in the skipped code stay quiet
+        ++current_;
+    }
 }
 
 bool Compiler::is_end() { return peek().type_ == TokenType::eof; }
 
-Token &Compiler::peek() { return toks_.at(current_); }
\ No newline at end of file
+Token &Compiler::peek() { return toks_.at(current_); }
+
+void Compiler::mark_roots(Heap &heap) {
+    // Marking a function marks its constants, including the functions it already finished
+    for (FunctionState *state = current_fn_; state != nullptr; state = state->enclosing_) {
+        heap.mark_object(state->function_);
+    }
+}
@@ -3,9 +3,12 @@
 
 #include "../common.hpp"
 #include "chunk/chunk.hpp"
+#include "memory/heap.hpp"
 #include "scanner/scanner.hpp"
+#include "vm/globals.hpp"
 #include "utilities/tokens.hpp"
 
+#include <cstdio>
 #include <stdexcept>
 
 struct CompilerError : public std::runtime_error {
@@ -14,22 +17,187 @@ struct CompilerError : public std::runtime_error {
         : std::runtime_error{message.c_str()}, tok_(tok) {}
 };
 
-struct Compiler {
-    Compiler(std::string source);
+// Binding power of each operator, lowest to highest
+enum class Precedence {
+    PREC_NONE,
+    PREC_ASSIGNMENT,  // =
+    PREC_CONDITIONAL, // ?:
+    PREC_OR,          // or
+    PREC_AND,         // and
+    PREC_EQUALITY,    // == !=
+    PREC_COMPARISON,  // < > <= >=
+    PREC_TERM,        // + -
+    PREC_FACTOR,      // * /
+    PREC_UNARY,       // ! -
+    PREC_CALL,        // . ()
+    PREC_PRIMARY
+};
+
+// A byte of emitted code that assumes a capture is copied, with the byte to
+// put there instead if the captured variable turns out to be reassigned
+struct CopySite {
+    Chunk *chunk_;
+    std::size_t offset_;
+    std::uint8_t boxed_;
+};
+
+// A local variable in scope at compile time. At runtime it is just the stack
+// slot matching its index in FunctionState::locals_, counted from the frame base
+struct Local {
+    Local(Token name, int depth) : name_(std::move(name)), depth_(depth) {}
+    Token name_;
+    // Scope depth it was declared at, -1 until its initializer has run
+    int depth_;
+    // Whether a closure captures it, locals nobody captures never pay for upvalues
+    bool captured_ = false;
+    // Whether it is assigned after its declaration, only then do captures need a box
+    bool assigned_ = false;
+    // We only know whether a captured local is reassigned once its scope ends,
+    // so captures are emitted as copies and patched if it was
+    std::vector<CopySite> copy_sites_;
+};
+
+struct FunctionState;
+
+// A variable a function captures from the functions around it
+struct Upvalue {
+    // Slot of a local of the enclosing function, or index of one of its upvalues
+    std::uint16_t index_;
+    bool is_local_;
+    // The function and slot of the local the capture ultimately refers to
+    FunctionState *origin_;
+    std::size_t slot_;
+};
+
+enum class FunctionType { TYPE_FUNCTION, TYPE_SCRIPT };
 
-    void compile();
+// Compile state of one function. Function declarations nest, so each state
+// links to the one of the function around it
+struct FunctionState {
+    FunctionState *enclosing_ = nullptr;
+    ObjFunction *function_ = nullptr;
+    FunctionType type_ = FunctionType::TYPE_SCRIPT;
+    // Locals in scope, innermost last. Slot 0 holds the function being called
+    std::vector<Local> locals_;
+    std::vector<Upvalue> upvalues_;
+    // 0 at the top level where variables are globals
+    int scope_depth_ = 0;
+};
+
+struct Compiler;
+using ParseFn = void (Compiler::*)();
+
+// Row of the Pratt table, how a token parses at the start of and inside an expression
+struct ParseRule {
+    ParseFn prefix_;
+    ParseFn infix_;
+    Precedence precedence_;
+};
+
+/*
+ * Single pass compiler, a Pratt parser that emits bytecode into the function
+ * being compiled as it goes instead of building an AST first. Functions and
+ * string constants are allocated on the VM heap, so while compiling we are a
+ * root source for the collector.
+ */
+struct Compiler : RootSource {
+    Compiler(std::string source, Heap &heap, Globals &globals);
+
+    // Function to compile the source into the script function, returns nullptr
+    // on a compile error
+    ObjFunction *compile();
+    void declaration();
+    void var_declaration();
+    void fun_declaration();
+    // Function to compile a function's parameters and body and emit it as a constant
+    void function(FunctionType type);
+    void begin_function(FunctionState &state, FunctionType type);
+    ObjFunction *end_function();
+    void disassemble(ObjFunction *function);
+    void statement();
+    void block();
+    void begin_scope();
+    void end_scope();
+    // Function to fix up the code that captured a local once we know whether it
+    // is ever reassigned
+    void settle_captures(Local &local);
+    void print_statement();
+    void return_statement();
+    void expression_statement();
     void expression();
+    void parse_precedence(Precedence precedence);
+    static ParseRule get_rule(TokenType type);
+
+    // Parse functions referenced from the rule table
+    void number();
+    void string();
+    void variable();
+    void literal();
+    void grouping();
+    void unary();
+    void binary();
+    void and_();
+    void or_();
+    void conditional();
+    void call();
+    std::uint8_t argument_list();
+
+    // Helpers to append bytecode
+    Chunk &current_chunk();
+    void emit_byte(std::uint8_t byte);
+    void emit_op(OpCode op);
+    std::uint8_t make_constant(Value value);
+    void emit_constant(Value value);
+    // Function to pop locals off the stack, in batches where we can
+    void emit_pops(std::size_t count);
+    // Every function ends by returning nil unless it returned earlier
+    void emit_return();
+    std::size_t emit_jump(OpCode op);
+    void patch_jump(std::size_t offset);
+    void emit_global(OpCode op, std::uint16_t slot);
+    // Function to emit a local access, picking the wide form for high slots
+    void emit_local(OpCode op, OpCode long_op, std::size_t slot);
+    // Function to resolve a global name to its slot
+    std::uint16_t global_slot(const Token &name);
+    // Function to find a local of a function by name, innermost first, returns
+    // -1 if it is not one
+    int resolve_local(FunctionState *state, const Token &name);
+    // Function to find a variable of an enclosing function and capture it
+    // through every function in between, returns -1 if it is not one
+    int resolve_upvalue(FunctionState *state, const Token &name);
+    int add_upvalue(FunctionState *state, Upvalue upvalue, const Token &name);
+    void add_local(const Token &name);
+    // Function to declare the variable just named, a no-op for globals
+    void declare_variable();
+    // Function to make the newest local visible, a no-op for globals
+    void mark_initialized();
+
     void consume(TokenType tok_t, std::string message);
-    Token advance();
-    Token previous();
-    void check_error();
+    bool check(TokenType tok_t);
+    bool match(TokenType tok_t);
+    Token &advance();
+    Token &previous();
     void report_error(CompilerError &error);
+    // Function to skip to the next statement after an error so we can keep reporting
+    void synchronize();
     bool is_end();
     Token &peek();
+    // The functions we are in the middle of compiling are only reachable through us
+    void mark_roots(Heap &heap) override;
     std::string source_;
-    Chunk chunk_;
+    // Innermost function being compiled
+    FunctionState *current_fn_ = nullptr;
+    Heap &heap_;
+    Globals &globals_;
     std::vector<Token> toks_;
-    int current_{0};
+    std::size_t current_{0};
+    bool had_error_{false};
+    // Whether the prefix expression being parsed may be an assignment target
+    bool can_assign_{false};
+    // Where compile errors are reported, the VM points this at its own stream
+    std::FILE *err_ = stderr;
+    // Print each function's bytecode once it is compiled
+    bool disassemble_ = false;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,150 @@
+#include "memory/heap.hpp"
+
+#include "heap.hpp"
+
+#include <algorithm>
+
+Heap::~Heap() {
+    while (objects_ != nullptr) {
+        Obj *next = objects_->next_;
+        free_object(objects_);
+        objects_ = next;
+    }
+}
+
+ObjString *Heap::intern(std::string chars) {
+    std::uint32_t hash = hash_string(chars);
+    if (ObjString *interned = strings_.find_string(chars, hash)) {
+        return interned;
+    }
+    ObjString *string = allocate<ObjString>(std::move(chars), hash);
+    strings_.set(string, Value::nil());
+    return string;
+}
+
+void Heap::add_roots(RootSource *roots) { roots_.push_back(roots); }
+
+void Heap::remove_roots(RootSource *roots) { std::erase(roots_, roots); }
+
+void Heap::collect() {
+    std::size_t before = bytes_allocated_;
+
+    for (RootSource *roots : roots_) {
+        roots->mark_roots(*this);
+    }
+    trace_references();
+    // Strings nothing else reaches are about to be freed, so they leave the table first
+    strings_.remove_white();
+    std::size_t freed = sweep();
+
+    next_gc_ = std::max(bytes_allocated_ * GROW_FACTOR, MIN_HEAP);
+    ++collections_;
+    if (log_) {
+        fmt::println(log_out_, "[gc] collection {}: freed {} objects, {} -> {} bytes, next at {}",
+                     collections_, freed, before, bytes_allocated_, next_gc_);
+    }
+}
+
+void Heap::mark_value(Value value) {
+    if (value.is_obj()) {
+        mark_object(value.as_obj());
+    }
+}
+
+void Heap::mark_object(Obj *object) {
+    if (object == nullptr || object->is_marked_) {
+        return;
+    }
+    object->is_marked_ = true;
+    // We use an explicit worklist so deep object graphs can't overflow the C++ stack
+    gray_.push_back(object);
+}
+
+std::size_t Heap::object_size(const Obj *object) {
+    switch (object->type_) {
+    case ObjType::OBJ_STRING:
+        return sizeof(ObjString) + static_cast<const ObjString *>(object)->chars_.capacity();
+    case ObjType::OBJ_FUNCTION:
+        // The chunk keeps growing after allocation, we only count the fixed part
+        return sizeof(ObjFunction);
+    case ObjType::OBJ_CLOSURE:
+        return sizeof(ObjClosure) +
+               static_cast<const ObjClosure *>(object)->upvalues_.capacity() * sizeof(Value);
+    case ObjType::OBJ_UPVALUE:
+        return sizeof(ObjUpvalue);
+    }
+    return 0;
+}
+
+void Heap::trace_references() {
+    while (!gray_.empty()) {
+        Obj *object = gray_.back();
+        gray_.pop_back();
+        blacken_object(object);
+    }
+}
+
+// Function to mark everything an object refers to
+void Heap::blacken_object(Obj *object) {
+    switch (object->type_) {
+    case ObjType::OBJ_STRING:
+        // Strings don't refer to anything
+        break;
+    case ObjType::OBJ_FUNCTION: {
+        auto *function = static_cast<ObjFunction *>(object);
+        mark_object(function->name_);
+        for (Value value : function->chunk_.constants_.values) {
+            mark_value(value);
+        }
+        break;
+    }
+    case ObjType::OBJ_CLOSURE: {
+        auto *closure = static_cast<ObjClosure *>(object);
+        mark_object(closure->function_);
+        for (Value value : closure->upvalues_) {
+            mark_value(value);
+        }
+        break;
+    }
+    case ObjType::OBJ_UPVALUE:
+        // An open upvalue's value is on the stack, which is a root anyway
+        mark_value(static_cast<ObjUpvalue *>(object)->closed_);
+        break;
+    }
+}
+
+std::size_t Heap::sweep() {
+    std::size_t freed = 0;
+    Obj **link = &objects_;
+    while (*link != nullptr) {
+        Obj *object = *link;
+        if (object->is_marked_) {
+            // Survivors start the next collection unmarked
+            object->is_marked_ = false;
+            link = &object->next_;
+        } else {
+            *link = object->next_;
+            free_object(object);
+            ++freed;
+        }
+    }
+    return freed;
+}
+
+void Heap::free_object(Obj *object) {
+    bytes_allocated_ -= object_size(object);
+    switch (object->type_) {
+    case ObjType::OBJ_STRING:
+        delete static_cast<ObjString *>(object);
+        break;
+    case ObjType::OBJ_FUNCTION:
+        delete static_cast<ObjFunction *>(object);
+        break;
+    case ObjType::OBJ_CLOSURE:
+        delete static_cast<ObjClosure *>(object);
+        break;
+    case ObjType::OBJ_UPVALUE:
+        delete static_cast<ObjUpvalue *>(object);
+        break;
+    }
+}
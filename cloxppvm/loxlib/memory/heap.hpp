@@ -0,0 +1,92 @@
+#ifndef CLOX_HEAP_HPP
+#define CLOX_HEAP_HPP
+
+#include "../common.hpp"
+#include "object/object.hpp"
+#include "table/table.hpp"
+#include "value/value.hpp"
+
+#include <cstdio>
+#include <string>
+
+struct Heap;
+
+// Anything that holds values the collector can't see on its own, the VM and
+// the compiler register themselves while they run
+struct RootSource {
+    virtual void mark_roots(Heap &heap) = 0;
+
+  protected:
+    ~RootSource() = default;
+};
+
+/*
+ * Owner of every VM heap object. Allocation counts bytes and once we pass
+ * next_gc_ we run a precise mark and sweep collection from the registered
+ * roots. After each collection the threshold is set to a multiple of what
+ * survived, so the heap stays proportional to the live data.
+ */
+struct Heap {
+    Heap() = default;
+    Heap(const Heap &) = delete;
+    Heap &operator=(const Heap &) = delete;
+    ~Heap();
+
+    // Function to allocate a new object, this may run a collection first so
+    // anything the caller still needs must be reachable from a root
+    template <typename T, typename... Args> T *allocate(Args &&...args) {
+        if (stress_ || bytes_allocated_ > next_gc_) {
+            collect();
+        }
+        T *object = new T(std::forward<Args>(args)...);
+        object->next_ = objects_;
+        objects_ = object;
+        bytes_allocated_ += object_size(object);
+        return object;
+    }
+
+    // Function to get the string with these contents, allocating it only if
+    // it doesn't exist yet
+    ObjString *intern(std::string chars);
+
+    void add_roots(RootSource *roots);
+    void remove_roots(RootSource *roots);
+
+    // Function to run a full collection now
+    void collect();
+    // Helpers for RootSource implementations
+    void mark_value(Value value);
+    void mark_object(Obj *object);
+
+    // Collect on every allocation, used to shake out missing roots
+    bool stress_ = false;
+    // Log every collection to log_out_
+    bool log_ = false;
+    std::FILE *log_out_ = stderr;
+
+    std::size_t bytes_allocated_ = 0;
+    std::size_t next_gc_ = MIN_HEAP;
+    std::size_t collections_ = 0;
+
+  private:
+    // We never collect before the heap reaches this size
+    static constexpr std::size_t MIN_HEAP = 1024 * 1024;
+    static constexpr std::size_t GROW_FACTOR = 2;
+
+    static std::size_t object_size(const Obj *object);
+    void trace_references();
+    void blacken_object(Obj *object);
+    // Helper to free unmarked objects, returns how many we freed
+    std::size_t sweep();
+    void free_object(Obj *object);
+
+    // Intrusive list of every object we allocated
+    Obj *objects_ = nullptr;
+    std::vector<RootSource *> roots_;
+    // Marked objects whose references we still have to visit
+    std::vector<Obj *> gray_;
+    // Every live string, the keys are weak so the table never keeps one alive
+    Table strings_;
+};
+
+#endif
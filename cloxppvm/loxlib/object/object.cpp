@@ -0,0 +1,20 @@
+#include "object/object.hpp"
+
+#include "object.hpp"
+
+std::string object_to_string(const Obj *object) {
+    switch (object->type_) {
+    case ObjType::OBJ_STRING:
+        return static_cast<const ObjString *>(object)->chars_;
+    case ObjType::OBJ_FUNCTION: {
+        const ObjString *name = static_cast<const ObjFunction *>(object)->name_;
+        return name == nullptr ? "<script>" : "<fn " + name->chars_ + ">";
+    }
+    case ObjType::OBJ_CLOSURE:
+        // Closures print as the function they wrap
+        return object_to_string(static_cast<const ObjClosure *>(object)->function_);
+    case ObjType::OBJ_UPVALUE:
+        return "upvalue";
+    }
+    return "<object>";
+}
@@ -0,0 +1,102 @@
+#ifndef CLOX_OBJECT_HPP
+#define CLOX_OBJECT_HPP
+
+#include "../common.hpp"
+#include "chunk/chunk.hpp"
+#include "value/value.hpp"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// The kinds of heap objects our VM understands
+enum class ObjType { OBJ_STRING, OBJ_FUNCTION, OBJ_CLOSURE, OBJ_UPVALUE };
+
+/*
+ * Header shared by every heap object. Objects are plain structs tagged with
+ * their type rather than a virtual hierarchy, and every one of them is linked
+ * into the heap's list of all objects so the collector can sweep them.
+ */
+struct Obj {
+    ObjType type_;
+    // Set while a collection finds the object reachable
+    bool is_marked_ = false;
+    Obj *next_ = nullptr;
+};
+
+// Function to hash string contents, 32 bit FNV-1a
+inline std::uint32_t hash_string(std::string_view chars) {
+    std::uint32_t hash = 2166136261u;
+    for (char c : chars) {
+        hash ^= static_cast<std::uint8_t>(c);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Strings are immutable and interned through Heap::intern, so two strings with
+// the same contents are always the same object
+struct ObjString : Obj {
+    ObjString(std::string chars, std::uint32_t hash)
+        : Obj{ObjType::OBJ_STRING}, chars_(std::move(chars)), hash_(hash) {}
+    std::string chars_;
+    // Cached so table lookups never rehash the characters
+    std::uint32_t hash_;
+};
+
+// A compiled function, the top level script is one too. Functions only exist
+// as constants, at runtime they are always wrapped in a closure
+struct ObjFunction : Obj {
+    ObjFunction() : Obj{ObjType::OBJ_FUNCTION} {}
+    int arity_ = 0;
+    // Number of variables the function captures from enclosing functions
+    int upvalue_count_ = 0;
+    Chunk chunk_;
+    // nullptr for the script
+    ObjString *name_ = nullptr;
+};
+
+/*
+ * A captured variable that is reassigned, so every closure capturing it shares
+ * this box. While the variable is still on the stack the upvalue is open and
+ * refers to its slot, by index since the stack can move when it grows. Once
+ * the variable goes out of scope the VM closes the upvalue by moving the value
+ * into closed_.
+ */
+struct ObjUpvalue : Obj {
+    explicit ObjUpvalue(std::size_t slot) : Obj{ObjType::OBJ_UPVALUE}, slot_(slot) {}
+    std::size_t slot_;
+    bool is_open_ = true;
+    Value closed_ = Value::nil();
+    // Next open upvalue, the VM keeps them sorted by slot from the top of the stack down
+    ObjUpvalue *next_open_ = nullptr;
+};
+
+// A function together with the variables it captured. Captures that are never
+// reassigned hold a copy of the value, the others hold an ObjUpvalue
+struct ObjClosure : Obj {
+    explicit ObjClosure(ObjFunction *function)
+        : Obj{ObjType::OBJ_CLOSURE}, function_(function),
+          upvalues_(static_cast<std::size_t>(function->upvalue_count_), Value::nil()) {}
+    ObjFunction *function_;
+    std::vector<Value> upvalues_;
+};
+
+// Helpers to check and unpack object values
+inline bool is_obj_type(Value value, ObjType type) {
+    return value.is_obj() && value.as_obj()->type_ == type;
+}
+inline bool is_string(Value value) { return is_obj_type(value, ObjType::OBJ_STRING); }
+inline ObjString *as_string(Value value) { return static_cast<ObjString *>(value.as_obj()); }
+inline bool is_function(Value value) { return is_obj_type(value, ObjType::OBJ_FUNCTION); }
+inline ObjFunction *as_function(Value value) {
+    return static_cast<ObjFunction *>(value.as_obj());
+}
+inline bool is_closure(Value value) { return is_obj_type(value, ObjType::OBJ_CLOSURE); }
+inline ObjClosure *as_closure(Value value) { return static_cast<ObjClosure *>(value.as_obj()); }
+inline ObjUpvalue *as_upvalue(Value value) { return static_cast<ObjUpvalue *>(value.as_obj()); }
+
+// Function to print an object the way Lox scripts expect to see it
+std::string object_to_string(const Obj *object);
+
+#endif
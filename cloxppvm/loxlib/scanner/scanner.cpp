@@ -93,6 +93,14 @@ void Scanner::scan() {
         make_token(TokenType::DOT);
         break;
     }
+    case '?': {
+        make_token(TokenType::QUESTION);
+        break;
+    }
+    case ':': {
+        make_token(TokenType::COLON);
+        break;
+    }
     case '!': {
         make_token(match('=') ? TokenType::BANG_EQUAL : TokenType::BANG);
         break;
@@ -113,6 +121,10 @@ void Scanner::scan() {
         string();
         break;
     }
+    default: {
+        error_token("Unexpected character.");
+        break;
+    }
     }
 }
 
@@ -190,14 +202,19 @@ void Scanner::identifier_type() {
                 break;
             }
             case 'o': {
-                check_keyword(2, "or", TokenType::FOR);
+                check_keyword(2, "r", TokenType::FOR);
                 break;
             }
             case 'u': {
-                check_keyword(2, "un", TokenType::FUN);
+                check_keyword(2, "n", TokenType::FUN);
                 break;
             }
+            default:
+                make_token(TokenType::IDENTIFIER);
+                break;
             }
+        } else {
+            make_token(TokenType::IDENTIFIER);
         }
         break;
     }
@@ -236,7 +253,12 @@ void Scanner::identifier_type() {
                 check_keyword(2, "ue", TokenType::TRUE);
                 break;
             }
+            default:
+                make_token(TokenType::IDENTIFIER);
+                break;
             }
+        } else {
+            make_token(TokenType::IDENTIFIER);
         }
         break;
     }
@@ -248,6 +270,10 @@ void Scanner::identifier_type() {
         check_keyword(1, "hile", TokenType::WHILE);
         break;
     }
+    default:
+        // Nothing else starts a keyword
+        make_token(TokenType::IDENTIFIER);
+        break;
     }
 }
 
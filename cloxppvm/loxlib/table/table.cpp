@@ -0,0 +1,132 @@
+#include "table/table.hpp"
+
+#include "memory/heap.hpp"
+#include "table.hpp"
+
+// We grow once three quarters of the slots are used
+static constexpr std::size_t MAX_LOAD_NUMERATOR = 3;
+static constexpr std::size_t MAX_LOAD_DENOMINATOR = 4;
+static constexpr std::size_t MIN_CAPACITY = 8;
+
+static bool is_tombstone(const Entry &entry) {
+    return entry.key_ == nullptr && !entry.value_.is_nil();
+}
+
+// Function to find the slot for key, either the one holding it or the slot it
+// should go in. We hand back the first tombstone we passed so deleted slots get
+// reused
+template <typename Entries> static auto *find_entry(Entries &entries, ObjString *key) {
+    std::size_t mask = entries.size() - 1;
+    decltype(&entries[0]) tombstone = nullptr;
+    for (std::size_t index = key->hash_ & mask;; index = (index + 1) & mask) {
+        auto *entry = &entries[index];
+        if (entry->key_ == key) {
+            return entry;
+        }
+        if (entry->key_ == nullptr) {
+            if (!is_tombstone(*entry)) {
+                return tombstone != nullptr ? tombstone : entry;
+            }
+            if (tombstone == nullptr) {
+                tombstone = entry;
+            }
+        }
+    }
+}
+
+bool Table::get(ObjString *key, Value *value) const {
+    if (count_ == 0) {
+        return false;
+    }
+    const Entry *entry = find_entry(entries_, key);
+    if (entry->key_ == nullptr) {
+        return false;
+    }
+    *value = entry->value_;
+    return true;
+}
+
+bool Table::set(ObjString *key, Value value) {
+    if ((count_ + 1) * MAX_LOAD_DENOMINATOR > entries_.size() * MAX_LOAD_NUMERATOR) {
+        adjust_capacity(entries_.empty() ? MIN_CAPACITY : entries_.size() * 2);
+    }
+    Entry *entry = find_entry(entries_, key);
+    bool is_new = entry->key_ == nullptr;
+    // Reusing a tombstone doesn't change the count, it was already included
+    if (is_new && !is_tombstone(*entry)) {
+        ++count_;
+    }
+    entry->key_ = key;
+    entry->value_ = value;
+    return is_new;
+}
+
+bool Table::remove(ObjString *key) {
+    if (count_ == 0) {
+        return false;
+    }
+    Entry *entry = find_entry(entries_, key);
+    if (entry->key_ == nullptr) {
+        return false;
+    }
+    entry->key_ = nullptr;
+    entry->value_ = Value::boolean(true);
+    return true;
+}
+
+void Table::add_all(const Table &from) {
+    for (const Entry &entry : from.entries_) {
+        if (entry.key_ != nullptr) {
+            set(entry.key_, entry.value_);
+        }
+    }
+}
+
+ObjString *Table::find_string(std::string_view chars, std::uint32_t hash) const {
+    if (count_ == 0) {
+        return nullptr;
+    }
+    std::size_t mask = entries_.size() - 1;
+    for (std::size_t index = hash & mask;; index = (index + 1) & mask) {
+        const Entry &entry = entries_[index];
+        if (entry.key_ == nullptr) {
+            // We keep walking past tombstones, only an empty slot ends the probe
+            if (!is_tombstone(entry)) {
+                return nullptr;
+            }
+        } else if (entry.key_->hash_ == hash && entry.key_->chars_ == chars) {
+            return entry.key_;
+        }
+    }
+}
+
+void Table::remove_white() {
+    for (Entry &entry : entries_) {
+        if (entry.key_ != nullptr && !entry.key_->is_marked_) {
+            entry.key_ = nullptr;
+            entry.value_ = Value::boolean(true);
+        }
+    }
+}
+
+void Table::mark(Heap &heap) const {
+    for (const Entry &entry : entries_) {
+        heap.mark_object(entry.key_);
+        heap.mark_value(entry.value_);
+    }
+}
+
+// Function to rehash into a new array, tombstones are dropped along the way
+void Table::adjust_capacity(std::size_t capacity) {
+    std::vector<Entry> entries(capacity);
+    count_ = 0;
+    for (const Entry &entry : entries_) {
+        if (entry.key_ == nullptr) {
+            continue;
+        }
+        Entry *dest = find_entry(entries, entry.key_);
+        *dest = entry;
+        ++count_;
+    }
+    entries_ = std::move(entries);
+}
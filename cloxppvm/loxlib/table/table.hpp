@@ -0,0 +1,50 @@
+#ifndef CLOX_TABLE_HPP
+#define CLOX_TABLE_HPP
+
+#include "../common.hpp"
+#include "object/object.hpp"
+#include "value/value.hpp"
+
+#include <cstdint>
+#include <string_view>
+
+struct Heap;
+
+// A slot of the table, an empty slot has no key and a nil value while a
+// deleted one (a tombstone) has no key and a true value
+struct Entry {
+    ObjString *key_ = nullptr;
+    Value value_ = Value::nil();
+};
+
+/*
+ * Hash table keyed by interned strings. Keys are compared by pointer and use
+ * the hash cached in the string, so a lookup never touches the characters.
+ * It uses open addressing with linear probing over a power of two array, and
+ * deletions leave tombstones behind so probe sequences stay intact.
+ */
+struct Table {
+    // Function to look a key up, returns false if it is missing
+    bool get(ObjString *key, Value *value) const;
+    // Function to add or overwrite a key, returns true if the key is new
+    bool set(ObjString *key, Value value);
+    // Function to delete a key, returns false if it was not there
+    bool remove(ObjString *key);
+    void add_all(const Table &from);
+
+    // Function to find an interned string by its contents, the only lookup that
+    // compares characters
+    ObjString *find_string(std::string_view chars, std::uint32_t hash) const;
+    // Helper for the collector, drops keys that were not marked
+    void remove_white();
+    void mark(Heap &heap) const;
+
+    // Live entries plus tombstones, both count towards the load factor
+    std::size_t count_ = 0;
+    std::vector<Entry> entries_;
+
+  private:
+    void adjust_capacity(std::size_t capacity);
+};
+
+#endif
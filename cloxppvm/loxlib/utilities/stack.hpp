@@ -1,47 +1,68 @@
 #ifndef CLOX_STACK_HPP
 #define CLOX_STACK_HPP
 
-#include <array>
 #include <cstdint>
-#include <fmt/base.h>
+#include <vector>
 
 // Custom Stack to push and pop values for Lox VM
 template <typename T, std::size_t N = 256> class Stack {
   private:
-    // We use an array as the size is known at compile time
-    // We default to 256 since Lox uses unit8_t size instructions
-    std::array<T, N> data_{};
+    // We start with room for N items and double whenever we run out, so deep
+    // call chains only pay for the depth they reach
+    std::vector<T> data_ = std::vector<T>(N);
     // Top always points to the location above the last item on the stack
     std::size_t top_ = 0;
 
   public:
-    // Main method to push items onto the stack, this method is safe
-    // as it has a size check
-    void push(const T &value) {
-        // We check the upper bounds
-        if (top_ >= N) {
-            fmt::print(stderr, "Stack overflow");
-            exit(64);
+    // Main method to push items onto the stack, growing it if it is full.
+    // Growing moves the items, so callers refer to slots by index rather than
+    // holding pointers across a push. We take the value by copy since it may
+    // be one of our own items
+    void push(T value) {
+        if (top_ == data_.size()) {
+            grow();
         }
         // We post-increment and save the value
         data_[top_++] = value;
     }
 
-    // Main method to pop items from the stack
+    // Main method to pop items from the stack, the stack must not be empty
     T &pop() {
-        // We check the lower bounds
-        if (top_ > 0) {
-            // We pre-increment and return the value
-            return data_[top_--];
-        }
+        // Top points past the last item so we pre-decrement
+        return data_[--top_];
     }
 
+    // Main method to drop several items at once, used when leaving a scope
+    void pop_n(std::size_t count) { top_ -= count; }
+
+    // Main method to look at items without popping them, 0 is the top
+    T &peek(std::size_t distance = 0) { return data_[top_ - 1 - distance]; }
+
+    // Main method to reach items by their slot, 0 is the bottom. Local
+    // variables live in these slots
+    T &operator[](std::size_t slot) { return data_[slot]; }
+
+    // Main method to double the capacity, items keep their slots
+    void grow() { data_.resize(data_.size() * 2); }
+
+    // Raw access for the tail call dispatch, which keeps pointers in registers
+    // and rebases them after a grow
+    T *base() { return data_.data(); }
+    T *top() { return data_.data() + top_; }
+    T *limit() { return data_.data() + data_.size(); }
+    void set_top(T *top) { top_ = static_cast<std::size_t>(top - data_.data()); }
+    // Helper method to cut the stack back to a slot, used when a call returns
+    void set_size(std::size_t size) { top_ = size; }
+
+    // Helper method to drop everything, used after a runtime error
+    void reset() { top_ = 0; }
+
     // Helper method to check if the stack is empty
     bool empty() const { return top_ == 0; }
-    // Helper method to check if the stack is full
-    bool full() const { return top_ == N; }
     // Helper method to check the size of the stack
     std::size_t size() const { return top_; }
+    // Helper method to check how many items fit before the next grow
+    std::size_t capacity() const { return data_.size(); }
 };
 
-#endif
\ No newline at end of file
+#endif
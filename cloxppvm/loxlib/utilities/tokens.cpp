@@ -52,6 +52,10 @@ auto fmt::formatter<TokenType>::format(TokenType ttype_t, format_context &ctx) c
         name = "COLON";
         break;
     }
+    case TokenType::QUESTION: {
+        name = "QUESTION";
+        break;
+    }
     case TokenType::BANG: {
         name = "BANG";
         break;
@@ -17,6 +17,7 @@ enum class TokenType {
     SLASH,
     STAR,
     COLON,
+    QUESTION,
 
     // One or two character tokens.
     BANG,
@@ -1,5 +1,24 @@
 #include "value/value.hpp"
 
+#include "object/object.hpp"
+
+auto fmt::formatter<Value>::format(Value value, format_context &ctx) const
+    -> format_context::iterator {
+    switch (value.type()) {
+    case ValueType::VAL_BOOL:
+        return formatter<string_view>::format(value.as_bool() ? "true" : "false", ctx);
+    case ValueType::VAL_NIL:
+        return formatter<string_view>::format("nil", ctx);
+    case ValueType::VAL_NUMBER:
+        return fmt::format_to(ctx.out(), "{}", value.as_number());
+    case ValueType::VAL_UNDEFINED:
+        return formatter<string_view>::format("undefined", ctx);
+    case ValueType::VAL_OBJ:
+        return formatter<string_view>::format(object_to_string(value.as_obj()), ctx);
+    }
+    return ctx.out();
+}
+
 ValueArray::ValueArray() {}
 
-void ValueArray::write_value_array(Value value) { values.push_back(value); }
\ No newline at end of file
+void ValueArray::write_value_array(Value value) { values.push_back(value); }
@@ -3,8 +3,185 @@
 
 #include "../common.hpp"
 
-// We create an alias for doubles to help our Lox mindset
-using Value = double;
+#include <bit>
+#include <cstdint>
+
+// The kinds of values our VM understands
+// VAL_UNDEFINED marks global slots that were never defined, scripts never see it
+enum class ValueType { VAL_BOOL, VAL_NIL, VAL_NUMBER, VAL_OBJ, VAL_UNDEFINED };
+
+// Heap objects live in object/object.hpp, values only carry the pointer
+struct Obj;
+
+/*
+ * Representations a Value can use, picked at build time by CLOXPPVM_VALUE.
+ * Each one is a policy with a Storage type and static functions to build,
+ * test and unpack it, so BasicValue below is the only code that knows which
+ * one is in use.
+ */
+namespace value_repr {
+
+// A 16 byte tagged union, the type sits next to the payload
+struct Tagged {
+    static constexpr const char *name = "tagged";
+
+    struct Storage {
+        ValueType type_;
+        union {
+            bool boolean_;
+            double number_;
+            Obj *obj_;
+        } as_;
+    };
+
+    static Storage nil() { return Storage{ValueType::VAL_NIL, {.number_ = 0.0}}; }
+    static Storage undefined() { return Storage{ValueType::VAL_UNDEFINED, {.number_ = 0.0}}; }
+    static Storage boolean(bool value) {
+        return Storage{ValueType::VAL_BOOL, {.boolean_ = value}};
+    }
+    static Storage number(double value) {
+        return Storage{ValueType::VAL_NUMBER, {.number_ = value}};
+    }
+    static Storage obj(Obj *value) { return Storage{ValueType::VAL_OBJ, {.obj_ = value}}; }
+
+    static ValueType type(Storage value) { return value.type_; }
+    static bool is_nil(Storage value) { return value.type_ == ValueType::VAL_NIL; }
+    static bool is_undefined(Storage value) { return value.type_ == ValueType::VAL_UNDEFINED; }
+    static bool is_bool(Storage value) { return value.type_ == ValueType::VAL_BOOL; }
+    static bool is_number(Storage value) { return value.type_ == ValueType::VAL_NUMBER; }
+    static bool is_obj(Storage value) { return value.type_ == ValueType::VAL_OBJ; }
+
+    static bool as_bool(Storage value) { return value.as_.boolean_; }
+    static double as_number(Storage value) { return value.as_.number_; }
+    static Obj *as_obj(Storage value) { return value.as_.obj_; }
+
+    static bool equal(Storage a, Storage b) {
+        if (a.type_ != b.type_) {
+            return false;
+        }
+        switch (a.type_) {
+        case ValueType::VAL_BOOL:
+            return a.as_.boolean_ == b.as_.boolean_;
+        case ValueType::VAL_NIL:
+        case ValueType::VAL_UNDEFINED:
+            return true;
+        case ValueType::VAL_NUMBER:
+            return a.as_.number_ == b.as_.number_;
+        case ValueType::VAL_OBJ:
+            return a.as_.obj_ == b.as_.obj_;
+        }
+        return false;
+    }
+};
+
+/*
+ * An 8 byte NaN boxed double. Numbers are stored as themselves, everything
+ * else hides in the payload of a quiet NaN that arithmetic never produces. The
+ * low bits tell nil, false, true and undefined apart, and objects set the sign bit and
+ * keep their pointer in the low 48 bits.
+ */
+struct NanBox {
+    static constexpr const char *name = "nanbox";
+
+    using Storage = std::uint64_t;
+
+    static constexpr Storage SIGN_BIT = 0x8000000000000000;
+    static constexpr Storage QNAN = 0x7ffc000000000000;
+    static constexpr Storage TAG_NIL = 1;
+    static constexpr Storage TAG_FALSE = 2;
+    static constexpr Storage TAG_TRUE = 3;
+    static constexpr Storage TAG_UNDEFINED = 4;
+
+    static Storage nil() { return QNAN | TAG_NIL; }
+    static Storage undefined() { return QNAN | TAG_UNDEFINED; }
+    static Storage boolean(bool value) { return QNAN | (value ? TAG_TRUE : TAG_FALSE); }
+    static Storage number(double value) { return std::bit_cast<Storage>(value); }
+    static Storage obj(Obj *value) { return SIGN_BIT | QNAN | reinterpret_cast<Storage>(value); }
+
+    static ValueType type(Storage value) {
+        if (is_number(value)) {
+            return ValueType::VAL_NUMBER;
+        }
+        if (is_obj(value)) {
+            return ValueType::VAL_OBJ;
+        }
+        if (is_undefined(value)) {
+            return ValueType::VAL_UNDEFINED;
+        }
+        return is_nil(value) ? ValueType::VAL_NIL : ValueType::VAL_BOOL;
+    }
+    static bool is_nil(Storage value) { return value == nil(); }
+    static bool is_undefined(Storage value) { return value == undefined(); }
+    // false and true only differ in the lowest bit
+    static bool is_bool(Storage value) { return (value | 1) == (QNAN | TAG_TRUE); }
+    static bool is_number(Storage value) { return (value & QNAN) != QNAN; }
+    static bool is_obj(Storage value) { return (value & (SIGN_BIT | QNAN)) == (SIGN_BIT | QNAN); }
+
+    static bool as_bool(Storage value) { return value == (QNAN | TAG_TRUE); }
+    static double as_number(Storage value) { return std::bit_cast<double>(value); }
+    static Obj *as_obj(Storage value) {
+        return reinterpret_cast<Obj *>(value & ~(SIGN_BIT | QNAN));
+    }
+
+    // Numbers compare as doubles so NaN stays unequal to itself and 0 equals -0
+    static bool equal(Storage a, Storage b) {
+        if (is_number(a) && is_number(b)) {
+            return as_number(a) == as_number(b);
+        }
+        return a == b;
+    }
+};
+
+} // namespace value_repr
+
+/*
+ * A Lox value. We never touch the representation outside of this file,
+ * everything goes through the constructors and accessors below.
+ */
+template <class Repr> struct BasicValue {
+    // Name of the representation, used to label benchmarks
+    static constexpr const char *repr_name = Repr::name;
+
+    // Constructors for each kind of value
+    static BasicValue nil() { return BasicValue{Repr::nil()}; }
+    static BasicValue undefined() { return BasicValue{Repr::undefined()}; }
+    static BasicValue boolean(bool value) { return BasicValue{Repr::boolean(value)}; }
+    static BasicValue number(double value) { return BasicValue{Repr::number(value)}; }
+    static BasicValue obj(Obj *value) { return BasicValue{Repr::obj(value)}; }
+
+    ValueType type() const { return Repr::type(repr_); }
+    bool is_nil() const { return Repr::is_nil(repr_); }
+    bool is_undefined() const { return Repr::is_undefined(repr_); }
+    bool is_bool() const { return Repr::is_bool(repr_); }
+    bool is_number() const { return Repr::is_number(repr_); }
+    bool is_obj() const { return Repr::is_obj(repr_); }
+
+    bool as_bool() const { return Repr::as_bool(repr_); }
+    double as_number() const { return Repr::as_number(repr_); }
+    Obj *as_obj() const { return Repr::as_obj(repr_); }
+
+    // nil and false are falsey, everything else is truthy
+    bool is_falsey() const { return is_nil() || (is_bool() && !as_bool()); }
+
+    // Lox equality, values of different types are never equal. Strings are
+    // interned so comparing objects by identity covers them too
+    friend bool values_equal(BasicValue a, BasicValue b) { return Repr::equal(a.repr_, b.repr_); }
+
+    typename Repr::Storage repr_;
+};
+
+#if defined(CLOX_NAN_BOXING)
+using Value = BasicValue<value_repr::NanBox>;
+static_assert(sizeof(Value) == 8);
+#else
+using Value = BasicValue<value_repr::Tagged>;
+static_assert(sizeof(Value) == 16);
+#endif
+
+// We print values the way Lox scripts expect to see them
+template <> struct fmt::formatter<Value> : formatter<string_view> {
+    auto format(Value value, format_context &ctx) const -> format_context::iterator;
+};
 
 // A simple data container for our Values
 struct ValueArray {
@@ -13,4 +190,4 @@ struct ValueArray {
     std::vector<Value> values;
 };
 
-#endif
\ No newline at end of file
+#endif
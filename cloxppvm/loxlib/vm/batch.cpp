@@ -0,0 +1,117 @@
+#include "vm/batch.hpp"
+
+#include "batch.hpp"
+#include "vm/vm.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+
+// If no job count is given we use every core
+BatchRunner::BatchRunner(unsigned jobs) : jobs_(jobs) {
+    if (jobs_ == 0) {
+        jobs_ = std::max(1u, std::thread::hardware_concurrency());
+    }
+}
+
+// Main logic for the worker pool
+void BatchRunner::run(const std::vector<std::string> &scripts,
+                      const std::function<void(const BatchResult &)> &report) {
+    // Workers claim scripts by bumping a shared index
+    std::atomic<std::size_t> next_script{0};
+
+    // Finished results wait here until everything before them has been reported
+    std::mutex mutex;
+    std::vector<std::optional<BatchResult>> results(scripts.size());
+    std::size_t next_report = 0;
+
+    auto worker = [&]() {
+        for (std::size_t i = next_script++; i < scripts.size(); i = next_script++) {
+            BatchResult result;
+            // An exception escaping this thread would terminate the whole batch, so
+            // it only fails the script that raised it
+            try {
+                result = run_one(scripts[i]);
+            } catch (const std::exception &error) {
+                result.path_ = scripts[i];
+                result.output_ = fmt::format("Error: {}\n", error.what());
+                result.exit_status_ = 70;
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            results[i] = std::move(result);
+            while (next_report < results.size() && results[next_report]) {
+                report(*results[next_report]);
+                // We do not need to hold on to output we already reported
+                results[next_report].reset();
+                ++next_report;
+            }
+        }
+    };
+
+    std::size_t count = std::min<std::size_t>(jobs_, std::max<std::size_t>(1, scripts.size()));
+    std::vector<std::thread> workers;
+    for (std::size_t i = 0; i < count; ++i) {
+        workers.emplace_back(worker);
+    }
+    for (std::thread &thread : workers) {
+        thread.join();
+    }
+}
+
+BatchResult BatchRunner::run_one(const std::string &path) {
+    BatchResult result;
+    result.path_ = path;
+
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        result.output_ = fmt::format("Error: Could not open file {}\n", path);
+        result.exit_status_ = 66;
+        return result;
+    }
+    std::string source((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    // We point the VM at an in memory stream so the output stays with this script
+    char *buffer = nullptr;
+    std::size_t size = 0;
+    std::FILE *capture = open_memstream(&buffer, &size);
+
+    // We still have to close the stream if the VM throws, what the script
+    // printed before that stays in its output
+    InterpretResult status = InterpretResult::INTERPRET_RUNTIME_ERROR;
+    try {
+        VM vm = VM(source);
+        if (capture != nullptr) {
+            vm.out_ = capture;
+            vm.err_ = capture;
+        }
+        status = vm.interpret();
+    } catch (const std::exception &error) {
+        fmt::print(capture != nullptr ? capture : stderr, "Error: {}\n", error.what());
+    }
+
+    if (capture != nullptr) {
+        std::fclose(capture);
+        result.output_.assign(buffer, size);
+        std::free(buffer);
+    }
+
+    switch (status) {
+    case InterpretResult::INTERPRET_OK:
+        result.exit_status_ = 0;
+        break;
+    case InterpretResult::INTERPRET_COMPILE_ERROR:
+        result.exit_status_ = 65;
+        break;
+    case InterpretResult::INTERPRET_RUNTIME_ERROR:
+        result.exit_status_ = 70;
+        break;
+    }
+    return result;
+}
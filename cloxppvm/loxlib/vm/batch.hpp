@@ -0,0 +1,33 @@
+#ifndef CLOX_BATCH_HPP
+#define CLOX_BATCH_HPP
+
+#include "../common.hpp"
+
+#include <functional>
+#include <string>
+
+// What we captured from running a single script of a batch
+struct BatchResult {
+    std::string path_;
+    // Everything the script wrote, errors included
+    std::string output_;
+    // 0 on success, 65 for compile errors, 66 if the file could not be read and
+    // 70 for runtime errors
+    int exit_status_ = 0;
+};
+
+/*
+ * Runs many scripts in one process on a pool of worker threads. Every script
+ * gets its own VM and output buffer, nothing mutable is shared between them.
+ */
+struct BatchRunner {
+    BatchRunner(unsigned jobs);
+    // Function to run every script, results are handed to report in input order
+    void run(const std::vector<std::string> &scripts,
+             const std::function<void(const BatchResult &)> &report);
+    // Function to run a single script with its output captured
+    BatchResult run_one(const std::string &path);
+    unsigned jobs_;
+};
+
+#endif
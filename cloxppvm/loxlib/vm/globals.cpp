@@ -0,0 +1,23 @@
+#include "vm/globals.hpp"
+
+#include "globals.hpp"
+#include "memory/heap.hpp"
+
+std::size_t Globals::slot_of(ObjString *name) {
+    Value slot = Value::nil();
+    if (slots_.get(name, &slot)) {
+        return static_cast<std::size_t>(slot.as_number());
+    }
+    std::size_t index = values_.size();
+    slots_.set(name, Value::number(static_cast<double>(index)));
+    values_.push_back(Value::undefined());
+    names_.push_back(name);
+    return index;
+}
+
+void Globals::mark(Heap &heap) const {
+    slots_.mark(heap);
+    for (Value value : values_) {
+        heap.mark_value(value);
+    }
+}
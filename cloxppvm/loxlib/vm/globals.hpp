@@ -0,0 +1,30 @@
+#ifndef CLOX_GLOBALS_HPP
+#define CLOX_GLOBALS_HPP
+
+#include "../common.hpp"
+#include "object/object.hpp"
+#include "table/table.hpp"
+#include "value/value.hpp"
+
+struct Heap;
+
+/*
+ * Global variables by slot. The compiler resolves every global name to a slot
+ * once and the bytecode carries the slot, so reading a global at runtime is a
+ * single vector load. Slots start out holding the undefined sentinel, so names
+ * are still bound late and using one before its definition runs is a runtime
+ * error as Lox expects.
+ */
+struct Globals {
+    // Function to get the slot of a name, the first lookup of a name adds it
+    std::size_t slot_of(ObjString *name);
+    void mark(Heap &heap) const;
+
+    // Name to slot number
+    Table slots_;
+    std::vector<Value> values_;
+    // Slot to name, used for error messages
+    std::vector<ObjString *> names_;
+};
+
+#endif
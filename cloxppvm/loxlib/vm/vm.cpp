@@ -2,83 +2,823 @@
 
 #include "vm.hpp"
 
-VM::VM(std::string source) : chunk_("test chunk") {}
+VM::VM(std::string source) : source_(std::move(source)) { heap_.add_roots(this); }
 
 InterpretResult VM::interpret() {
-    ip_ = 0;
-    return InterpretResult::INTERPRET_OK;
+    // We compile the whole source up front
+    heap_.log_out_ = err_;
+    Compiler compiler = Compiler(source_, heap_, globals_);
+    compiler.err_ = err_;
+    compiler.disassemble_ = disassemble_;
+    ObjFunction *function = compiler.compile();
+    if (function == nullptr) {
+        return InterpretResult::INTERPRET_COMPILE_ERROR;
+    }
+    return run_function(function);
 }
 
-InterpretResult VM::run() {
-    // We create an infinite loop to run the byte code
-    for (;;) {
-        OpCode instruction = static_cast<OpCode>(chunk_.code_[ip_]);
-        switch (instruction) {
-        case OpCode::OP_CONSTANT: {
-            // We look ahead to snag the index
-            Value constant = chunk_.constants_.values[chunk_.code_[ip_ + 1]];
-            // We push our value onto the stack
-            stack_.push(constant);
-            ip_ += 2;
+InterpretResult VM::run_function(ObjFunction *function) {
+    stack_.reset();
+    frame_count_ = 0;
+    open_upvalues_ = nullptr;
+    // The script sits in slot 0 of its frame like any other callee. It stays
+    // on the stack while we wrap it so a collection can't free it
+    stack_.push(Value::obj(function));
+    ObjClosure *closure = heap_.allocate<ObjClosure>(function);
+    stack_.peek() = Value::obj(closure);
+    if (!call(closure, 0)) {
+        return InterpretResult::INTERPRET_RUNTIME_ERROR;
+    }
+    return run();
+}
+
+bool VM::call_value(Value callee, std::size_t arg_count) {
+    if (is_closure(callee)) {
+        return call(as_closure(callee), arg_count);
+    }
+    runtime_error("Can only call functions and classes.");
+    return false;
+}
+
+// Calls only set up a frame over the arguments already on the stack, nothing
+// is copied
+bool VM::call(ObjClosure *closure, std::size_t arg_count) {
+    ObjFunction *function = closure->function_;
+    if (arg_count != static_cast<std::size_t>(function->arity_)) {
+        runtime_error("Expected {} arguments but got {}.", function->arity_, arg_count);
+        return false;
+    }
+    if (frame_count_ == max_frames_) {
+        runtime_error("Stack overflow.");
+        return false;
+    }
+    if (frame_count_ == frames_.size()) {
+        frames_.resize(std::min(frames_.size() * 2, max_frames_));
+    }
+    frames_[frame_count_++] =
+        CallFrame{closure, function->chunk_.code_.data(), stack_.size() - arg_count - 1};
+    return true;
+}
+
+void VM::make_closure(ObjFunction *function, const std::uint8_t *ip, std::size_t slots) {
+    // We push the closure before capturing anything, which roots it while we
+    // allocate upvalues. A local function that refers to itself captures the
+    // slot the closure was just pushed into
+    ObjClosure *closure = heap_.allocate<ObjClosure>(function);
+    stack_.push(Value::obj(closure));
+    const ObjClosure *enclosing = frames_[frame_count_ - 1].closure_;
+    const std::uint8_t *capture = ip + 2;
+    for (Value &upvalue : closure->upvalues_) {
+        std::size_t index = static_cast<std::size_t>(capture[1] << 8 | capture[2]);
+        switch (static_cast<CaptureKind>(capture[0])) {
+        case CaptureKind::CAPTURE_ENCLOSING:
+            upvalue = enclosing->upvalues_[index];
+            break;
+        case CaptureKind::CAPTURE_COPY:
+            upvalue = stack_[slots + index];
+            break;
+        case CaptureKind::CAPTURE_BOX:
+            upvalue = Value::obj(capture_upvalue(slots + index));
             break;
         }
-        case OpCode::OP_ADD: {
+        capture += 3;
+    }
+}
+
+ObjUpvalue *VM::capture_upvalue(std::size_t slot) {
+    // Closures capturing the same variable share one upvalue, so we look for it
+    // in the sorted list first
+    ObjUpvalue **link = &open_upvalues_;
+    while (*link != nullptr && (*link)->slot_ > slot) {
+        link = &(*link)->next_open_;
+    }
+    if (*link != nullptr && (*link)->slot_ == slot) {
+        return *link;
+    }
+    // Open upvalues are roots, so collecting here leaves the list as it was
+    ObjUpvalue *created = heap_.allocate<ObjUpvalue>(slot);
+    created->next_open_ = *link;
+    *link = created;
+    return created;
+}
+
+void VM::close_upvalues(std::size_t last) {
+    while (open_upvalues_ != nullptr && open_upvalues_->slot_ >= last) {
+        ObjUpvalue *upvalue = open_upvalues_;
+        upvalue->closed_ = stack_[upvalue->slot_];
+        upvalue->is_open_ = false;
+        open_upvalues_ = upvalue->next_open_;
+    }
+}
+
+// Helper to read the 16 bit big endian operand of the instruction at ip
+static inline std::size_t read_short(const std::uint8_t *ip) {
+    return static_cast<std::size_t>(ip[1] << 8 | ip[2]);
+}
+
+#if defined(CLOX_TAIL_CALL)
+
+/*
+ * Tail call dispatch. Every opcode gets its own small function and each one
+ * finishes by calling the handler for the next instruction in tail position,
+ * so the compiler turns the call into a jump. The hot state (instruction
+ * pointer, stack top, constant pool, frame slots and globals) travels in
+ * argument registers instead of living in the VM, and we only write it back
+ * when we leave the handlers or call into the VM.
+ */
+#if defined(__has_cpp_attribute) && __has_cpp_attribute(clang::musttail)
+#define VM_MUSTTAIL [[clang::musttail]]
+#elif defined(__has_cpp_attribute) && __has_cpp_attribute(gnu::musttail)
+#define VM_MUSTTAIL [[gnu::musttail]]
+#else
+// Without the attribute we rely on sibling call optimisation, so this mode
+// needs an optimised build
+#define VM_MUSTTAIL
+#endif
+
+namespace {
+
+// Handlers that don't need part of the state still have to pass it along
+#define VM_HANDLER_ARGS                                                                       \
+    VM &vm, const std::uint8_t *ip, Value *sp, [[maybe_unused]] const Value *constants,       \
+        [[maybe_unused]] Value *slots, [[maybe_unused]] Value *globals
+using Handler = InterpretResult (*)(VM &, const std::uint8_t *, Value *, const Value *, Value *,
+                                    Value *);
+
+#define VM_DECLARE_HANDLER(op) InterpretResult op##_handler(VM_HANDLER_ARGS);
+CLOX_OPCODES(VM_DECLARE_HANDLER)
+
+#define VM_HANDLER_ADDRESS(op) &op##_handler,
+constexpr Handler handlers[] = {CLOX_OPCODES(VM_HANDLER_ADDRESS)};
+
+#define VM_NEXT() VM_MUSTTAIL return handlers[*ip](vm, ip, sp, constants, slots, globals)
+
+// Helper to hand the register state back to the VM before we leave the handlers
+inline void save_state(VM &vm, const std::uint8_t *ip, Value *sp) {
+    vm.frames_[vm.frame_count_ - 1].ip_ = ip;
+    vm.stack_.set_top(sp);
+}
+
+// Helper to load the registers of the frame on top after a call or return
+inline void load_frame(VM &vm, const std::uint8_t *&ip, const Value *&constants, Value *&slots) {
+    const CallFrame &frame = vm.frames_[vm.frame_count_ - 1];
+    ip = frame.ip_;
+    constants = frame.closure_->function_->chunk_.constants_.values.data();
+    slots = vm.stack_.base() + frame.slots_;
+}
+
+// Helper to push in a handler. When the stack is full it grows, which moves
+// it, so both pointers into it are rebased
+inline void push(VM &vm, Value *&sp, Value *&slots, Value value) {
+    if (sp == vm.stack_.limit()) {
+        std::size_t frame_base = static_cast<std::size_t>(slots - vm.stack_.base());
+        vm.stack_.set_top(sp);
+        vm.stack_.grow();
+        sp = vm.stack_.top();
+        slots = vm.stack_.base() + frame_base;
+    }
+    *sp++ = value;
+}
+
+// Helper for binary operators, the same checks as VM::binary_op but on the
+// register stack top. Returns false after reporting a runtime error
+template <class Op> inline bool binary(VM &vm, const std::uint8_t *ip, Value *&sp, Op op) {
+    if (!sp[-1].is_number() || !sp[-2].is_number()) {
+        save_state(vm, ip, sp);
+        vm.runtime_error("Operands must be numbers.");
+        return false;
+    }
+    double b = sp[-1].as_number();
+    double a = sp[-2].as_number();
+    if constexpr (std::is_same_v<Op, std::divides<void>>) {
+        if (b == 0.0) {
+            save_state(vm, ip, sp);
+            vm.runtime_error("Error: Division by zero");
+            return false;
+        }
+    }
+    --sp;
+    if constexpr (std::is_same_v<decltype(op(a, b)), bool>) {
+        sp[-1] = Value::boolean(op(a, b));
+    } else {
+        sp[-1] = Value::number(op(a, b));
+    }
+    return true;
+}
+
+InterpretResult OP_CONSTANT_handler(VM_HANDLER_ARGS) {
+    push(vm, sp, slots, constants[ip[1]]);
+    ip += 2;
+    VM_NEXT();
+}
+
+InterpretResult OP_NIL_handler(VM_HANDLER_ARGS) {
+    push(vm, sp, slots, Value::nil());
+    ip += 1;
+    VM_NEXT();
+}
+
+InterpretResult OP_TRUE_handler(VM_HANDLER_ARGS) {
+    push(vm, sp, slots, Value::boolean(true));
+    ip += 1;
+    VM_NEXT();
+}
+
+InterpretResult OP_FALSE_handler(VM_HANDLER_ARGS) {
+    push(vm, sp, slots, Value::boolean(false));
+    ip += 1;
+    VM_NEXT();
+}
+
+InterpretResult OP_POP_handler(VM_HANDLER_ARGS) {
+    --sp;
+    ip += 1;
+    VM_NEXT();
+}
+
+InterpretResult OP_EQUAL_handler(VM_HANDLER_ARGS) {
+    --sp;
+    sp[-1] = Value::boolean(values_equal(sp[-1], sp[0]));
+    ip += 1;
+    VM_NEXT();
+}
+
+#define VM_BINARY_HANDLER(op, function)                                                       \
+    InterpretResult op##_handler(VM_HANDLER_ARGS) {                                           \
+        if (!binary(vm, ip, sp, function{})) {                                                \
+            return InterpretResult::INTERPRET_RUNTIME_ERROR;                                  \
+        }                                                                                     \
+        ip += 1;                                                                              \
+        VM_NEXT();                                                                            \
+    }
+
+VM_BINARY_HANDLER(OP_GREATER, std::greater<>)
+VM_BINARY_HANDLER(OP_LESS, std::less<>)
+VM_BINARY_HANDLER(OP_SUBTRACT, std::minus<>)
+VM_BINARY_HANDLER(OP_MULTIPLY, std::multiplies<>)
+VM_BINARY_HANDLER(OP_DIVIDE, std::divides<>)
+
+// + adds numbers and concatenates strings
+InterpretResult OP_ADD_handler(VM_HANDLER_ARGS) {
+    if (sp[-1].is_number() && sp[-2].is_number()) {
+        binary(vm, ip, sp, std::plus<>{});
+    } else if (is_string(sp[-1]) && is_string(sp[-2])) {
+        // Concatenating allocates, so the collector has to see our stack top
+        save_state(vm, ip, sp);
+        vm.concatenate();
+        sp = vm.stack_.top();
+    } else {
+        save_state(vm, ip, sp);
+        vm.runtime_error("Operands must be two numbers or two strings.");
+        return InterpretResult::INTERPRET_RUNTIME_ERROR;
+    }
+    ip += 1;
+    VM_NEXT();
+}
+
+InterpretResult OP_NOT_handler(VM_HANDLER_ARGS) {
+    sp[-1] = Value::boolean(sp[-1].is_falsey());
+    ip += 1;
+    VM_NEXT();
+}
+
+InterpretResult OP_NEGATE_handler(VM_HANDLER_ARGS) {
+    if (!sp[-1].is_number()) {
+        save_state(vm, ip, sp);
+        vm.runtime_error("Operand must be a number.");
+        return InterpretResult::INTERPRET_RUNTIME_ERROR;
+    }
+    sp[-1] = Value::number(-sp[-1].as_number());
+    ip += 1;
+    VM_NEXT();
+}
+
+InterpretResult OP_JUMP_handler(VM_HANDLER_ARGS) {
+    std::size_t offset = read_short(ip);
+    ip += 3 + offset;
+    VM_NEXT();
+}
+
+InterpretResult OP_JUMP_IF_FALSE_handler(VM_HANDLER_ARGS) {
+    // The condition stays on the stack, the compiler pops it on both paths
+    std::size_t offset = read_short(ip);
+    ip += 3;
+    if (sp[-1].is_falsey()) {
+        ip += offset;
+    }
+    VM_NEXT();
+}
+
+InterpretResult OP_PRINT_handler(VM_HANDLER_ARGS) {
+    --sp;
+    fmt::println(vm.out_, "{}", *sp);
+    ip += 1;
+    VM_NEXT();
+}
+
+InterpretResult OP_DEFINE_GLOBAL_handler(VM_HANDLER_ARGS) {
+    --sp;
+    globals[read_short(ip)] = *sp;
+    ip += 3;
+    VM_NEXT();
+}
+
+InterpretResult OP_GET_GLOBAL_handler(VM_HANDLER_ARGS) {
+    std::size_t slot = read_short(ip);
+    Value value = globals[slot];
+    if (value.is_undefined()) {
+        save_state(vm, ip, sp);
+        vm.runtime_error("Undefined variable '{}'.", vm.globals_.names_[slot]->chars_);
+        return InterpretResult::INTERPRET_RUNTIME_ERROR;
+    }
+    push(vm, sp, slots, value);
+    ip += 3;
+    VM_NEXT();
+}
+
+// Assignment never creates a global, the value stays on the stack as the result
+InterpretResult OP_SET_GLOBAL_handler(VM_HANDLER_ARGS) {
+    std::size_t slot = read_short(ip);
+    if (globals[slot].is_undefined()) {
+        save_state(vm, ip, sp);
+        vm.runtime_error("Undefined variable '{}'.", vm.globals_.names_[slot]->chars_);
+        return InterpretResult::INTERPRET_RUNTIME_ERROR;
+    }
+    globals[slot] = sp[-1];
+    ip += 3;
+    VM_NEXT();
+}
+
+// Locals are addressed by their slot from the frame base
+InterpretResult OP_GET_LOCAL_handler(VM_HANDLER_ARGS) {
+    push(vm, sp, slots, slots[ip[1]]);
+    ip += 2;
+    VM_NEXT();
+}
+
+InterpretResult OP_SET_LOCAL_handler(VM_HANDLER_ARGS) {
+    slots[ip[1]] = sp[-1];
+    ip += 2;
+    VM_NEXT();
+}
+
+InterpretResult OP_GET_LOCAL_LONG_handler(VM_HANDLER_ARGS) {
+    push(vm, sp, slots, slots[read_short(ip)]);
+    ip += 3;
+    VM_NEXT();
+}
+
+InterpretResult OP_SET_LOCAL_LONG_handler(VM_HANDLER_ARGS) {
+    slots[read_short(ip)] = sp[-1];
+    ip += 3;
+    VM_NEXT();
+}
+
+InterpretResult OP_POPN_handler(VM_HANDLER_ARGS) {
+    sp -= ip[1];
+    ip += 2;
+    VM_NEXT();
+}
+
+InterpretResult OP_CALL_handler(VM_HANDLER_ARGS) {
+    std::size_t arg_count = ip[1];
+    save_state(vm, ip, sp);
+    if (!vm.call_value(sp[-1 - static_cast<std::ptrdiff_t>(arg_count)], arg_count)) {
+        return InterpretResult::INTERPRET_RUNTIME_ERROR;
+    }
+    load_frame(vm, ip, constants, slots);
+    VM_NEXT();
+}
+
+InterpretResult OP_CLOSURE_handler(VM_HANDLER_ARGS) {
+    ObjFunction *function = as_function(constants[ip[1]]);
+    // Allocating may collect and pushing may grow the stack
+    save_state(vm, ip, sp);
+    vm.make_closure(function, ip, static_cast<std::size_t>(slots - vm.stack_.base()));
+    sp = vm.stack_.top();
+    slots = vm.stack_.base() + vm.frames_[vm.frame_count_ - 1].slots_;
+    ip += 2 + 3 * static_cast<std::size_t>(function->upvalue_count_);
+    VM_NEXT();
+}
+
+// Helper to get the closure of the frame on top, which upvalue opcodes read from
+inline ObjClosure *current_closure(VM &vm) { return vm.frames_[vm.frame_count_ - 1].closure_; }
+
+InterpretResult OP_GET_UPVALUE_handler(VM_HANDLER_ARGS) {
+    ObjUpvalue *upvalue = as_upvalue(current_closure(vm)->upvalues_[ip[1]]);
+    push(vm, sp, slots, upvalue->is_open_ ? vm.stack_[upvalue->slot_] : upvalue->closed_);
+    ip += 2;
+    VM_NEXT();
+}
+
+InterpretResult OP_SET_UPVALUE_handler(VM_HANDLER_ARGS) {
+    ObjUpvalue *upvalue = as_upvalue(current_closure(vm)->upvalues_[ip[1]]);
+    (upvalue->is_open_ ? vm.stack_[upvalue->slot_] : upvalue->closed_) = sp[-1];
+    ip += 2;
+    VM_NEXT();
+}
+
+// Captures that are never reassigned live in the closure itself
+InterpretResult OP_GET_UPVALUE_COPY_handler(VM_HANDLER_ARGS) {
+    push(vm, sp, slots, current_closure(vm)->upvalues_[ip[1]]);
+    ip += 2;
+    VM_NEXT();
+}
+
+InterpretResult OP_CLOSE_UPVALUE_handler(VM_HANDLER_ARGS) {
+    vm.close_upvalues(static_cast<std::size_t>(sp - 1 - vm.stack_.base()));
+    --sp;
+    ip += 1;
+    VM_NEXT();
+}
+
+// The callee's whole window is dropped and the result takes the callee's slot
+InterpretResult OP_RETURN_handler(VM_HANDLER_ARGS) {
+    Value result = sp[-1];
+    // Anything the callee captured by reference outlives its window
+    vm.close_upvalues(static_cast<std::size_t>(slots - vm.stack_.base()));
+    sp = slots;
+    if (--vm.frame_count_ == 0) {
+        // The script's own slot goes too, the stack ends up empty
+        vm.stack_.set_top(sp);
+        return InterpretResult::INTERPRET_OK;
+    }
+    *sp++ = result;
+    load_frame(vm, ip, constants, slots);
+    // The caller resumes after its OP_CALL
+    ip += 2;
+    VM_NEXT();
+}
+
+#undef VM_BINARY_HANDLER
+#undef VM_NEXT
+#undef VM_HANDLER_ADDRESS
+#undef VM_DECLARE_HANDLER
+#undef VM_HANDLER_ARGS
+
+} // namespace
+
+InterpretResult VM::run() {
+    const std::uint8_t *ip;
+    const Value *constants;
+    Value *slots;
+    load_frame(*this, ip, constants, slots);
+    return handlers[*ip](*this, ip, stack_.top(), constants, slots, globals_.values_.data());
+}
+
+#undef VM_MUSTTAIL
+
+#else
+
+/*
+ * The dispatch loop. Handlers are written once against three macros:
+ * VM_CASE labels a handler, VM_NEXT moves on to the next instruction and
+ * VM_DISPATCH_BEGIN/END wrap the handlers. With CLOX_COMPUTED_GOTO every handler
+ * ends in its own indirect jump through a table of label addresses, which the
+ * branch predictor can learn per opcode. Otherwise we fall back to a portable
+ * switch inside a loop.
+ */
+#if defined(CLOX_COMPUTED_GOTO)
+// Labels as values are a GNU extension, we only use them behind the build option
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#define VM_DISPATCH_BEGIN()                                                                   \
+    static const void *const dispatch_table[] = {CLOX_OPCODES(VM_LABEL_ADDRESS)};            \
+    VM_NEXT();
+#define VM_DISPATCH_END()
+#define VM_LABEL_ADDRESS(op) &&L_##op,
+#define VM_CASE(op) L_##op
+#define VM_NEXT() goto *dispatch_table[*frame->ip_]
+#else
+#define VM_DISPATCH_BEGIN()                                                                   \
+    for (;;) {                                                                                \
+        switch (static_cast<OpCode>(*frame->ip_)) {
+#define VM_DISPATCH_END()                                                                     \
+    }                                                                                         \
+    }
+#define VM_CASE(op) case OpCode::op
+#define VM_NEXT() continue
+#endif
+
+InterpretResult VM::run() {
+    // The frame on top, we reload it whenever a call or return changes it
+    CallFrame *frame = &frames_[frame_count_ - 1];
+    VM_DISPATCH_BEGIN()
+    VM_CASE(OP_CONSTANT) : {
+        // We look ahead to snag the index
+        Value constant = frame->closure_->function_->chunk_.constants_.values[frame->ip_[1]];
+        // We push our value onto the stack
+        stack_.push(constant);
+        frame->ip_ += 2;
+        VM_NEXT();
+    }
+    VM_CASE(OP_NIL) : {
+        stack_.push(Value::nil());
+        frame->ip_ += 1;
+        VM_NEXT();
+    }
+    VM_CASE(OP_TRUE) : {
+        stack_.push(Value::boolean(true));
+        frame->ip_ += 1;
+        VM_NEXT();
+    }
+    VM_CASE(OP_FALSE) : {
+        stack_.push(Value::boolean(false));
+        frame->ip_ += 1;
+        VM_NEXT();
+    }
+    VM_CASE(OP_POP) : {
+        stack_.pop();
+        frame->ip_ += 1;
+        VM_NEXT();
+    }
+    VM_CASE(OP_EQUAL) : {
+        Value b = stack_.pop();
+        Value a = stack_.pop();
+        stack_.push(Value::boolean(values_equal(a, b)));
+        frame->ip_ += 1;
+        VM_NEXT();
+    }
+    VM_CASE(OP_GREATER) : {
+        if (!binary_op(std::greater<>{})) {
+            return InterpretResult::INTERPRET_RUNTIME_ERROR;
+        }
+        frame->ip_ += 1;
+        VM_NEXT();
+    }
+    VM_CASE(OP_LESS) : {
+        if (!binary_op(std::less<>{})) {
+            return InterpretResult::INTERPRET_RUNTIME_ERROR;
+        }
+        frame->ip_ += 1;
+        VM_NEXT();
+    }
+    VM_CASE(OP_ADD) : {
+        // + adds numbers and concatenates strings
+        if (stack_.peek(0).is_number() && stack_.peek(1).is_number()) {
             binary_op(std::plus<>{});
-            ip_ += 1;
-            break;
+        } else if (is_string(stack_.peek(0)) && is_string(stack_.peek(1))) {
+            concatenate();
+        } else {
+            runtime_error("Operands must be two numbers or two strings.");
+            return InterpretResult::INTERPRET_RUNTIME_ERROR;
         }
-        case OpCode::OP_SUBTRACT: {
-            binary_op(std::minus<>{});
-            ip_ += 1;
-            break;
+        frame->ip_ += 1;
+        VM_NEXT();
+    }
+    VM_CASE(OP_SUBTRACT) : {
+        if (!binary_op(std::minus<>{})) {
+            return InterpretResult::INTERPRET_RUNTIME_ERROR;
         }
-        case OpCode::OP_DIVIDE: {
-            binary_op(std::divides<>{});
-            ip_ += 1;
-            break;
+        frame->ip_ += 1;
+        VM_NEXT();
+    }
+    VM_CASE(OP_DIVIDE) : {
+        if (!binary_op(std::divides<>{})) {
+            return InterpretResult::INTERPRET_RUNTIME_ERROR;
         }
-        case OpCode::OP_MULTIPLY: {
-            binary_op(std::multiplies<>{});
-            ip_ += 1;
-            break;
+        frame->ip_ += 1;
+        VM_NEXT();
+    }
+    VM_CASE(OP_MULTIPLY) : {
+        if (!binary_op(std::multiplies<>{})) {
+            return InterpretResult::INTERPRET_RUNTIME_ERROR;
         }
-        case OpCode::OP_NEGATE: {
-            // We need to store the top value
-            Value constant = stack_.pop();
-            // We can then negate the value
-            stack_.push((-constant));
-            ip_ += 1;
-            break;
+        frame->ip_ += 1;
+        VM_NEXT();
+    }
+    VM_CASE(OP_NOT) : {
+        stack_.push(Value::boolean(stack_.pop().is_falsey()));
+        frame->ip_ += 1;
+        VM_NEXT();
+    }
+    VM_CASE(OP_NEGATE) : {
+        if (!stack_.peek().is_number()) {
+            runtime_error("Operand must be a number.");
+            return InterpretResult::INTERPRET_RUNTIME_ERROR;
         }
-        case OpCode::OP_RETURN: {
-            // We simply print the top value then pop it off the stack
-            fmt::println("{}", stack_.pop());
-            return InterpretResult::INTERPRET_OK;
-            break;
+        // We need to store the top value
+        Value constant = stack_.pop();
+        // We can then negate the value
+        stack_.push(Value::number(-constant.as_number()));
+        frame->ip_ += 1;
+        VM_NEXT();
+    }
+    VM_CASE(OP_JUMP) : {
+        std::size_t offset = read_short(frame->ip_);
+        frame->ip_ += 3 + offset;
+        VM_NEXT();
+    }
+    VM_CASE(OP_JUMP_IF_FALSE) : {
+        // The condition stays on the stack, the compiler pops it on both paths
+        std::size_t offset = read_short(frame->ip_);
+        frame->ip_ += 3;
+        if (stack_.peek().is_falsey()) {
+            frame->ip_ += offset;
+        }
+        VM_NEXT();
+    }
+    VM_CASE(OP_PRINT) : {
+        fmt::println(out_, "{}", stack_.pop());
+        frame->ip_ += 1;
+        VM_NEXT();
+    }
+    VM_CASE(OP_DEFINE_GLOBAL) : {
+        globals_.values_[read_short(frame->ip_)] = stack_.pop();
+        frame->ip_ += 3;
+        VM_NEXT();
+    }
+    VM_CASE(OP_GET_GLOBAL) : {
+        std::size_t slot = read_short(frame->ip_);
+        Value value = globals_.values_[slot];
+        if (value.is_undefined()) {
+            runtime_error("Undefined variable '{}'.", globals_.names_[slot]->chars_);
+            return InterpretResult::INTERPRET_RUNTIME_ERROR;
+        }
+        stack_.push(value);
+        frame->ip_ += 3;
+        VM_NEXT();
+    }
+    VM_CASE(OP_SET_GLOBAL) : {
+        // Assignment never creates a global, the value stays on the stack as the result
+        std::size_t slot = read_short(frame->ip_);
+        if (globals_.values_[slot].is_undefined()) {
+            runtime_error("Undefined variable '{}'.", globals_.names_[slot]->chars_);
+            return InterpretResult::INTERPRET_RUNTIME_ERROR;
+        }
+        globals_.values_[slot] = stack_.peek();
+        frame->ip_ += 3;
+        VM_NEXT();
+    }
+    VM_CASE(OP_GET_LOCAL) : {
+        // Locals are addressed by their slot from the frame base
+        stack_.push(stack_[frame->slots_ + frame->ip_[1]]);
+        frame->ip_ += 2;
+        VM_NEXT();
+    }
+    VM_CASE(OP_SET_LOCAL) : {
+        stack_[frame->slots_ + frame->ip_[1]] = stack_.peek();
+        frame->ip_ += 2;
+        VM_NEXT();
+    }
+    VM_CASE(OP_GET_LOCAL_LONG) : {
+        stack_.push(stack_[frame->slots_ + read_short(frame->ip_)]);
+        frame->ip_ += 3;
+        VM_NEXT();
+    }
+    VM_CASE(OP_SET_LOCAL_LONG) : {
+        stack_[frame->slots_ + read_short(frame->ip_)] = stack_.peek();
+        frame->ip_ += 3;
+        VM_NEXT();
+    }
+    VM_CASE(OP_POPN) : {
+        stack_.pop_n(frame->ip_[1]);
+        frame->ip_ += 2;
+        VM_NEXT();
+    }
+    VM_CASE(OP_CALL) : {
+        std::size_t arg_count = frame->ip_[1];
+        if (!call_value(stack_.peek(arg_count), arg_count)) {
+            return InterpretResult::INTERPRET_RUNTIME_ERROR;
         }
+        // The callee starts at its first instruction, the caller stays at the
+        // call until it returns
+        frame = &frames_[frame_count_ - 1];
+        VM_NEXT();
+    }
+    VM_CASE(OP_CLOSURE) : {
+        const ObjFunction *current = frame->closure_->function_;
+        ObjFunction *function = as_function(current->chunk_.constants_.values[frame->ip_[1]]);
+        make_closure(function, frame->ip_, frame->slots_);
+        frame->ip_ += 2 + 3 * static_cast<std::size_t>(function->upvalue_count_);
+        VM_NEXT();
+    }
+    VM_CASE(OP_GET_UPVALUE) : {
+        ObjUpvalue *upvalue = as_upvalue(frame->closure_->upvalues_[frame->ip_[1]]);
+        stack_.push(upvalue->is_open_ ? stack_[upvalue->slot_] : upvalue->closed_);
+        frame->ip_ += 2;
+        VM_NEXT();
+    }
+    VM_CASE(OP_SET_UPVALUE) : {
+        ObjUpvalue *upvalue = as_upvalue(frame->closure_->upvalues_[frame->ip_[1]]);
+        (upvalue->is_open_ ? stack_[upvalue->slot_] : upvalue->closed_) = stack_.peek();
+        frame->ip_ += 2;
+        VM_NEXT();
+    }
+    VM_CASE(OP_GET_UPVALUE_COPY) : {
+        // Captures that are never reassigned live in the closure itself
+        stack_.push(frame->closure_->upvalues_[frame->ip_[1]]);
+        frame->ip_ += 2;
+        VM_NEXT();
+    }
+    VM_CASE(OP_CLOSE_UPVALUE) : {
+        close_upvalues(stack_.size() - 1);
+        stack_.pop();
+        frame->ip_ += 1;
+        VM_NEXT();
+    }
+    VM_CASE(OP_RETURN) : {
+        // The callee's whole window is dropped and the result takes the callee's
+        // slot. Anything it captured by reference outlives the window
+        Value result = stack_.pop();
+        close_upvalues(frame->slots_);
+        stack_.set_size(frame->slots_);
+        if (--frame_count_ == 0) {
+            return InterpretResult::INTERPRET_OK;
         }
+        stack_.push(result);
+        frame = &frames_[frame_count_ - 1];
+        frame->ip_ += 2;
+        VM_NEXT();
     }
+    VM_DISPATCH_END()
 }
 
+#undef VM_DISPATCH_BEGIN
+#undef VM_DISPATCH_END
+#undef VM_CASE
+#undef VM_NEXT
+#if defined(CLOX_COMPUTED_GOTO)
+#undef VM_LABEL_ADDRESS
+#pragma GCC diagnostic pop
+#endif
+
+#endif
+
 void VM::debug_stack() {
-    for (int it = 0; it < stack_.size(); ++it) {
-        fmt::println("{}", stack_.pop());
+    for (std::size_t it = 0; it < stack_.size(); ++it) {
+        fmt::println("{}", stack_.peek(it));
     }
 }
 
-// A little helper for binary operators
-template <class Op> inline void VM::binary_op(Op op) {
+void VM::concatenate() {
+    // Both operands stay on the stack until the result exists, since allocating
+    // may run a collection
+    ObjString *b = as_string(stack_.peek(0));
+    ObjString *a = as_string(stack_.peek(1));
+    ObjString *result = heap_.intern(a->chars_ + b->chars_);
+    stack_.pop();
+    stack_.pop();
+    stack_.push(Value::obj(result));
+}
+
+void VM::mark_roots(Heap &heap) {
+    globals_.mark(heap);
+    for (std::size_t it = 0; it < stack_.size(); ++it) {
+        heap.mark_value(stack_.peek(it));
+    }
+    for (std::size_t it = 0; it < frame_count_; ++it) {
+        heap.mark_object(frames_[it].closure_);
+    }
+    for (ObjUpvalue *upvalue = open_upvalues_; upvalue != nullptr; upvalue = upvalue->next_open_) {
+        heap.mark_object(upvalue);
+    }
+}
+
+// Runtime errors print a trace of the calls in progress, innermost first,
+// with the line of the instruction each frame is executing
+template <typename... Args>
+void VM::runtime_error(fmt::format_string<Args...> format, Args &&...args) {
+    fmt::println(err_, format, std::forward<Args>(args)...);
+    for (std::size_t it = frame_count_; it-- > 0;) {
+        const CallFrame &frame = frames_[it];
+        const ObjFunction *function = frame.closure_->function_;
+        const Chunk &chunk = function->chunk_;
+        int line = chunk.lines_[static_cast<std::size_t>(frame.ip_ - chunk.code_.data())];
+        if (function->name_ == nullptr) {
+            fmt::println(err_, "[line {}] in script", line);
+        } else {
+            fmt::println(err_, "[line {}] in {}()", line, function->name_->chars_);
+        }
+    }
+    stack_.reset();
+    frame_count_ = 0;
+    open_upvalues_ = nullptr;
+}
+
+// A little helper for binary operators, returns false on a runtime error
+template <class Op> inline bool VM::binary_op(Op op) {
+    if (!stack_.peek(0).is_number() || !stack_.peek(1).is_number()) {
+        runtime_error("Operands must be numbers.");
+        return false;
+    }
     // We get the second value
-    double b = stack_.pop();
+    double b = stack_.pop().as_number();
     // We then get the ssecond value
-    double a = stack_.pop();
+    double a = stack_.pop().as_number();
     // We add a division by zero check
     if constexpr (std::is_same_v<Op, std::divides<void>>) {
         if (b == 0.0) {
-            fmt::println(stderr, "Error: Division by zero");
-            exit(1);
+            runtime_error("Error: Division by zero");
+            return false;
         }
     }
-    // We then push the result of the operation onto the stack
-    stack_.push(op(a, b));
-}
\ No newline at end of file
+    // We then push the result of the operation onto the stack, comparisons give
+    // us a bool and arithmetic a number
+    if constexpr (std::is_same_v<decltype(op(a, b)), bool>) {
+        stack_.push(Value::boolean(op(a, b)));
+    } else {
+        stack_.push(Value::number(op(a, b)));
+    }
+    return true;
+}
@@ -4,23 +4,86 @@
 #include "../common.hpp"
 #include "chunk/chunk.hpp"
 #include "compiler/compiler.hpp"
+#include "memory/heap.hpp"
+#include "object/object.hpp"
 #include "utilities/stack.hpp"
+#include "vm/globals.hpp"
 
 #include <functional>
 #include <type_traits>
 
+// Name of the dispatch loop this build uses, picked by CLOXPPVM_DISPATCH
+#if defined(CLOX_TAIL_CALL)
+inline constexpr const char *DISPATCH_NAME = "tail";
+#elif defined(CLOX_COMPUTED_GOTO)
+inline constexpr const char *DISPATCH_NAME = "goto";
+#else
+inline constexpr const char *DISPATCH_NAME = "switch";
+#endif
+
 enum class InterpretResult { INTERPRET_OK, INTERPRET_COMPILE_ERROR, INTERPRET_RUNTIME_ERROR };
 
-struct VM {
+// A call in progress. Every frame shares the VM's value stack, its window
+// starts at the callee and its arguments, which become the first locals
+struct CallFrame {
+    ObjClosure *closure_;
+    // Instruction being executed, a suspended caller's points at its OP_CALL
+    const std::uint8_t *ip_;
+    // Stack slot of the callee. We keep an index rather than a pointer so
+    // growing the stack never leaves a frame dangling
+    std::size_t slots_;
+};
+
+// The VM is a root source for its heap, the stack, frames and globals hold its objects
+struct VM : RootSource {
+    // Default for max_frames_, deep enough for any sane recursion
+    static constexpr std::size_t DEFAULT_MAX_FRAMES = 16384;
+
     VM(std::string source);
+    // Function to compile the source and run it
     InterpretResult interpret();
+    // Function to run a compiled script from a fresh stack
+    InterpretResult run_function(ObjFunction *function);
     InterpretResult run();
     void debug_stack();
 
-    template <class Op> inline void binary_op(Op op);
-    Chunk chunk_;
-    std::size_t ip_;
+    // Function to call a value with its arguments on the stack, pushes the
+    // new frame or reports a runtime error and returns false
+    bool call_value(Value callee, std::size_t arg_count);
+    bool call(ObjClosure *closure, std::size_t arg_count);
+    // Function to push a closure over function for OP_CLOSURE, reading the
+    // capture operands that follow the instruction at ip
+    void make_closure(ObjFunction *function, const std::uint8_t *ip, std::size_t slots);
+    // Function to find or create the open upvalue for a stack slot
+    ObjUpvalue *capture_upvalue(std::size_t slot);
+    // Function to close every open upvalue at or above a stack slot
+    void close_upvalues(std::size_t last);
+    template <class Op> inline bool binary_op(Op op);
+    void concatenate();
+    void mark_roots(Heap &heap) override;
+    // Function to report a runtime error at the current instruction
+    template <typename... Args>
+    void runtime_error(fmt::format_string<Args...> format, Args &&...args);
+
+    std::string source_;
+    // Declared before the stack and frames so objects outlive what points at them
+    Heap heap_;
+    Globals globals_;
     Stack<Value, 256> stack_;
+    // Frames are allocated in doubling steps as calls get deeper, so a call
+    // only allocates the first time the program reaches its depth
+    std::vector<CallFrame> frames_ = std::vector<CallFrame>(64);
+    std::size_t frame_count_ = 0;
+    // Upvalues still pointing into the stack, highest slot first
+    ObjUpvalue *open_upvalues_ = nullptr;
+    // Calls nested deeper than this are a stack overflow
+    std::size_t max_frames_ = DEFAULT_MAX_FRAMES;
+    // Print the compiled bytecode before running it
+    bool disassemble_ = false;
+    // Where the program writes its output and errors, the batch runner
+    // points these at per script buffers
+    std::FILE *out_ = stdout;
+    std::FILE *err_ = stderr;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,47 @@
+#ifndef CLOXPP_BATCH_SCRIPTS_HPP
+#define CLOXPP_BATCH_SCRIPTS_HPP
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+/*
+ * Helpers the tree walker and the VM share, both are built from the same
+ * sources so a batch means the same thing to either engine.
+ */
+namespace cloxpp {
+
+// Function to expand a directory of .lox files or a file listing one script per
+// line into the scripts of a batch, in a stable order
+inline std::vector<std::string> collect_batch_scripts(const std::string &source) {
+    namespace fs = std::filesystem;
+    std::vector<std::string> scripts;
+
+    // A directory means every .lox file below it
+    if (fs::is_directory(source)) {
+        for (const fs::directory_entry &entry : fs::recursive_directory_iterator(source)) {
+            if (entry.is_regular_file() && entry.path().extension() == ".lox") {
+                scripts.push_back(entry.path().string());
+            }
+        }
+        std::sort(scripts.begin(), scripts.end());
+        return scripts;
+    }
+
+    // Otherwise we expect a list with one path per line, blank lines and lines
+    // starting with '#' are skipped
+    std::ifstream list(source);
+    std::string line;
+    while (std::getline(list, line)) {
+        if (!line.empty() && line[0] != '#') {
+            scripts.push_back(line);
+        }
+    }
+    return scripts;
+}
+
+} // namespace cloxpp
+
+#endif